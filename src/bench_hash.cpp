@@ -0,0 +1,140 @@
+#include "hash.h"
+#include "group.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+
+// hashes/s and group probe lengths for each hash policy on a few key shapes
+// probe lengths come from replaying the table's own group probing at MAX_LOAD_PCT
+
+using Clock = std::chrono::high_resolution_clock;
+
+struct KeySet {
+    std::string name;
+    std::vector<std::string> keys;
+};
+
+std::vector<KeySet> make_key_sets(const size_t n) {
+    std::mt19937_64 gen(42);
+    std::uniform_int_distribution<int> alnum(0, 35);
+    std::uniform_int_distribution<int> len(8, 24);
+    const char* digits = "0123456789abcdefghijklmnopqrstuvwxyz";
+
+    std::vector<KeySet> sets(4);
+    sets[0].name = "key_<n>";
+    sets[1].name = "user:<id>:session";
+    sets[2].name = "random 8-24";
+    sets[3].name = "url 48";
+
+    for (size_t i = 0; i < n; i++) {
+        sets[0].keys.push_back("key_" + std::to_string(i));
+        sets[1].keys.push_back("user:" + std::to_string(i * 7919 % 10'000'019) + ":session");
+
+        std::string r(len(gen), ' ');
+        for (char& c : r) c = digits[alnum(gen)];
+        sets[2].keys.push_back(r);
+
+        std::string id(16, ' ');
+        for (char& c : id) c = digits[alnum(gen) % 16];
+        sets[3].keys.push_back("https://api.example.com/v1/items/" + id);
+    }
+    return sets;
+}
+
+template<typename H>
+void bench(const KeySet& set) {
+    const auto& keys = set.keys;
+    const H hasher;
+
+    // throughput
+    uint64_t sink = 0;
+    constexpr int rounds = 5;
+    const auto t1 = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        for (const auto& k : keys) sink ^= hasher(k);
+    }
+    const auto t2 = Clock::now();
+    const double ns = std::chrono::duration<double, std::nano>(t2 - t1).count() / (keys.size() * rounds);
+
+    // fill a ctrl array the way set() does
+    size_t cap = INIT_CAPACITY;
+    while (cap * MAX_LOAD_PCT / 100 < keys.size()) cap <<= 1;
+    std::vector<atomic<uint8_t>> ctrl(cap);
+    std::vector<uint32_t> owner(cap);
+    const size_t gmask = cap / GROUP_WIDTH - 1;
+
+    for (uint32_t id = 0; id < keys.size(); id++) {
+        const uint64_t h = hasher(keys[id]);
+        const size_t step = step_of(h);
+        for (size_t j = 0; j <= gmask; j++) {
+            const size_t base = ((h + j * step) & gmask) * GROUP_WIDTH;
+            const Group grp(&ctrl[base]);
+            size_t free_i = cap;
+            for (const size_t b : grp.match_free()) {
+                if (ctrl[base + b].load(relaxed) == CTRL_EMPTY) {
+                    free_i = base + b;
+                    break;
+                }
+            }
+            if (free_i == cap) continue;
+            ctrl[free_i].store(tag_of(h), relaxed);
+            owner[free_i] = id;
+            break;
+        }
+    }
+
+    // look every key back up
+    uint64_t total_groups = 0;
+    uint64_t max_groups = 0;
+    uint64_t false_tags = 0;
+    for (uint32_t id = 0; id < keys.size(); id++) {
+        const uint64_t h = hasher(keys[id]);
+        const size_t step = step_of(h);
+        const uint8_t tag = tag_of(h);
+        uint64_t groups = 0;
+        bool found = false;
+        for (size_t j = 0; j <= gmask && !found; j++) {
+            const size_t base = ((h + j * step) & gmask) * GROUP_WIDTH;
+            const Group grp(&ctrl[base]);
+            groups++;
+            for (const size_t b : grp.match(tag)) {
+                if (ctrl[base + b].load(relaxed) != tag) continue;
+                if (owner[base + b] == id) {
+                    found = true;
+                    break;
+                }
+                false_tags++;
+            }
+        }
+        total_groups += groups;
+        max_groups = std::max(max_groups, groups);
+    }
+
+    std::cout << std::fixed
+              << "    " << std::left << std::setw(18) << set.name << std::setw(12) << H::name << std::right
+              << std::setprecision(2) << ns << " ns/hash | "
+              << std::setprecision(1) << (1e3 / ns) << "M/s | "
+              << "groups avg=" << std::setprecision(3) << static_cast<double>(total_groups) / keys.size()
+              << " max=" << max_groups
+              << " | false tags/lookup=" << static_cast<double>(false_tags) / keys.size()
+              << (sink == 42 ? " " : "") << "\n";
+}
+
+int main(const int argc, char** argv) {
+    const size_t n = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+    std::cout << "\n" << n << " keys | group width " << GROUP_WIDTH << " | load " << MAX_LOAD_PCT << "%\n\n";
+
+    for (const auto& set : make_key_sets(n)) {
+        bench<Legacy31>(set);
+        bench<Djb2>(set);
+        bench<WyHash>(set);
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+        bench<Crc32Hash>(set);
+#endif
+        std::cout << "\n";
+    }
+    return 0;
+}
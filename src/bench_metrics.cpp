@@ -1,5 +1,5 @@
 #include <vector>
-#include <mutex>
+#include <algorithm>
 #include <thread>
 #include <chrono>
 #include <string>
@@ -8,18 +8,31 @@
 #include <iomanip>
 #include <atomic>
 #include <iostream>
-
-extern std::string get_spin_metrics(int total_set_ops);
-extern std::string get_transition_metrics();
-
-std::mutex S;
-std::atomic<int> _active{0};
-std::atomic<int> _total{0};
-std::atomic<int> _set_total{0};
-std::vector<int> _samples;
-
-std::mutex L;
-std::vector<double> _lats;
+#include <mutex>
+#include "registry.h"
+#include "hist.h"
+#include "metrics.h"
+
+extern std::string get_slab_metrics();
+
+// one record per connection thread, each on lines of its own ; only its thread writes it,
+// plain loads and stores, and nothing is summed until someone asks for a report
+struct alignas(64) ReqStats {
+    std::atomic<int> active{0};
+    std::atomic<uint64_t> round{0};     // START these counts belong to ; the owner clears them on a new one
+    std::atomic<uint64_t> total{0};
+    std::atomic<uint64_t> sets{0};
+    std::atomic<uint64_t> served{0};    // since the process started ; never cleared
+    std::atomic<uint64_t> served_sets{0};
+    Hist lat_ns;
+};
+
+Registry<ReqStats> req_stats;
+std::atomic<uint64_t> cur_round{0};
+thread_local ReqStats* my_stats = nullptr;
+const auto up_since = std::chrono::steady_clock::now();
+
+std::vector<int> _samples;      // sampler thread only
 
 int expc = 0;
 std::chrono::high_resolution_clock::time_point start_time;
@@ -30,25 +43,75 @@ std::atomic stop_bthread{false};
 
 constexpr int sampling_interval_ms = 5;
 
+// this thread's record, cleared if a START came since it last counted
+ReqStats& mine() {
+    if (my_stats == nullptr) my_stats = &req_stats[req_stats.acquire()];
+    ReqStats& r = *my_stats;
+    const uint64_t round = cur_round.load(std::memory_order_relaxed);
+    if (r.round.load(std::memory_order_relaxed) != round) {
+        r.total.store(0, std::memory_order_relaxed);
+        r.sets.store(0, std::memory_order_relaxed);
+        r.lat_ns.clear();
+        r.round.store(round, std::memory_order_relaxed);
+    }
+    return r;
+}
+
+// the current round's records ; threads that served nothing since START still hold an old one
+template<typename F>
+void for_round(F&& f) {
+    const uint64_t round = cur_round.load(std::memory_order_relaxed);
+    req_stats.for_each([&](const ReqStats& r) {
+        if (r.round.load(std::memory_order_relaxed) == round) f(r);
+    });
+}
+
+uint64_t sum_total() {
+    uint64_t n = 0;
+    for_round([&](const ReqStats& r) { n += r.total.load(std::memory_order_relaxed); });
+    return n;
+}
+
+uint64_t sum_sets() {
+    uint64_t n = 0;
+    for_round([&](const ReqStats& r) { n += r.sets.load(std::memory_order_relaxed); });
+    return n;
+}
+
+void report();
+
+// samples concurrency and watches for the expected request count ; the run ends on the
+// first sample that sees it, so duration is good to sampling_interval_ms
 void sample() {
     while (!stop_bthread.load()) {
-        {
-            std::lock_guard lock(S);
-            _samples.push_back(_active.load());
+        int active = 0;
+        req_stats.for_each([&](const ReqStats& r) { active += r.active.load(std::memory_order_relaxed); });
+        _samples.push_back(active);
+
+        if (sum_total() >= static_cast<uint64_t>(expc)) {
+            const auto end_time = std::chrono::high_resolution_clock::now();
+            dur = std::chrono::duration<double>(end_time - start_time).count();
+            report();
+            return;
         }
         std::this_thread::sleep_for(std::chrono::milliseconds(sampling_interval_ms));
     }
 }
 
+// STARTs may come in on two loop threads at once ; one at a time swaps the sampler
 void start(const int expected, const int admin_socket) {
-    std::lock_guard _(S);
-    std::lock_guard __(L);
+    static std::mutex start_lock;
+    const std::lock_guard hold(start_lock);
+
+    if (bthread) {
+        stop_bthread.store(true);
+        bthread->join();
+        delete bthread;
+        bthread = nullptr;
+    }
 
-    _active.store(0);
-    _total.store(0);
-    _set_total.store(0);
     _samples.clear();
-    _lats.clear();
+    cur_round.fetch_add(1, std::memory_order_relaxed);
 
     expc = expected;
     admin_fd = admin_socket;
@@ -58,24 +121,15 @@ void start(const int expected, const int admin_socket) {
 }
 
 std::string get_metrics() {
-    std::vector<int> sorted_samples;
-    std::vector<double> sorted_lats;
-
-    {
-        std::lock_guard lock(S);
-        sorted_samples = _samples;
-    }
-
-    {
-        std::lock_guard lock(L);
-        sorted_lats = _lats;
-    }
+    std::vector<int> sorted_samples = _samples;
+    Hist lats;
+    for_round([&](const ReqStats& r) { lats.merge(r.lat_ns); });
+    const uint64_t total = sum_total();
+    const uint64_t sets = sum_sets();
 
     std::ranges::sort(sorted_samples);
-    std::ranges::sort(sorted_lats);
 
     const int ns = sorted_samples.size();
-    const int nl = sorted_lats.size();
 
     const int peak = *std::ranges::max_element(sorted_samples);
     const int minC = sorted_samples[0];
@@ -91,59 +145,84 @@ std::string get_metrics() {
     for (const int s : sorted_samples) if (s > 1) contention_count++;
     const double conten = static_cast<double>(contention_count) / ns * 100;
 
-    const double minL = sorted_lats[0];
-    const double maxL = sorted_lats[nl - 1];
-    double meanL = 0;
-    for (double l : sorted_lats) meanL += l;
-    meanL /= nl;
-
-    const double p50L = sorted_lats[static_cast<size_t>(nl) * 50 / 100];
-    const double p95L = sorted_lats[static_cast<size_t>(nl) * 95 / 100];
-    const double p99L = sorted_lats[static_cast<size_t>(nl) * 99 / 100];
-    const double p999L = sorted_lats[static_cast<size_t>(nl) * 999 / 1000];
+    const auto ms = [](const double v) { return v / 1'000'000.0; };
 
     std::ostringstream oss;
     oss << std::fixed << std::setprecision(3);
-    oss << "    Latency (ms): min=" << minL << " | max=" << maxL << " | mean=" << meanL << " | p50=" << p50L << " | p95=" << p95L << " | p99=" << p99L << " | p999=" << p999L << "\n";
+    oss << "    Latency (ms): min=" << ms(lats.min()) << " | max=" << ms(lats.max()) << " | mean=" << ms(lats.mean())
+        << " | p50=" << ms(lats.percentile(50)) << " | p95=" << ms(lats.percentile(95))
+        << " | p99=" << ms(lats.percentile(99)) << " | p999=" << ms(lats.percentile(99.9)) << "\n";
     oss << std::setprecision(2);
-    oss << "    Throughput:   requests=" << _total.load() << " | duration=" << dur << "s | rate=" << (_total.load()/dur/1'000'000.0) << "M req/s\n";
+    oss << "    Throughput:   requests=" << total << " | duration=" << dur << "s | rate=" << (total / dur / 1'000'000.0) << "M req/s\n";
     oss << std::setprecision(1);
     oss << "    Concurrency:  peak=" << peak << " | min=" << minC << " | mean=" << meanC << " | p50=" << p50C << " | p95=" << p95C << " | p99=" << p99C << " | contention=" << conten << "%\n";
-    oss << "    Operations:   sets=" << _set_total.load() << " | total=" << _total.load() << "\n\n";
-    oss << get_spin_metrics(_set_total.load());
+    oss << "    Operations:   sets=" << sets << " | total=" << total << "\n\n";
+    oss << get_spin_metrics(sets);
     oss << get_transition_metrics();
+    oss << get_slab_metrics();
 
     return oss.str();
 }
 
-void inc_set_count() { _set_total.fetch_add(1, std::memory_order_relaxed); }
-
-void inc_active() {
-    _active.fetch_add(1, std::memory_order_relaxed);
+void report() {
+    const std::string metrics = get_metrics();
+    write(admin_fd, metrics.c_str(), metrics.size());
 }
 
-void dec_active_log_lat(const double latency_ms) {
-    _active.fetch_sub(1, std::memory_order_relaxed);
-    int completed = _total.fetch_add(1, std::memory_order_relaxed) + 1;
-
+// STATS and /metrics ; read off the live records, nothing is reset or paused
+// latency is the current START round's, since the process came up if there never was one
+// requests_per_second is over the time since the previous call for the same format
+std::string get_stats(const std::vector<std::atomic<Table*>*>& roots, const bool prometheus) {
+    uint64_t served = 0, served_sets = 0;
+    int active = 0;
+    req_stats.for_each([&](const ReqStats& r) {
+        served += r.served.load(std::memory_order_relaxed);
+        served_sets += r.served_sets.load(std::memory_order_relaxed);
+        active += r.active.load(std::memory_order_relaxed);
+    });
+    Hist lats;
+    for_round([&](const ReqStats& r) { lats.merge(r.lat_ns); });
+
+    static std::mutex rate_lock;
+    static uint64_t last_served[2]{};
+    static std::chrono::steady_clock::time_point last_at[2]{up_since, up_since};
+    const auto now = std::chrono::steady_clock::now();
+    double rate;
     {
-        std::lock_guard _(L);
-        _lats.push_back(latency_ms);
+        const std::lock_guard hold(rate_lock);
+        const double secs = std::chrono::duration<double>(now - last_at[prometheus]).count();
+        rate = secs > 0 ? (served - last_served[prometheus]) / secs : 0;
+        last_served[prometheus] = served;
+        last_at[prometheus] = now;
     }
 
-    if (completed == expc) {
-        stop_bthread.store(true);
+    std::vector<Stat> stats;
+    stats.push_back({"zoom_uptime_seconds", "gauge", "Seconds since the server started.", "", "", std::chrono::duration<double>(now - up_since).count()});
+    stats.push_back({"zoom_requests_total", "counter", "Requests served.", "", "", static_cast<double>(served)});
+    stats.push_back({"zoom_sets_total", "counter", "Keys written by SET, MSET and binary sets.", "", "", static_cast<double>(served_sets)});
+    stats.push_back({"zoom_requests_per_second", "gauge", "Requests served per second since the previous scrape.", "", "", rate});
+    stats.push_back({"zoom_requests_active", "gauge", "Requests being served right now.", "", "", static_cast<double>(active)});
+    add_summary(stats, "zoom_request_latency_seconds", "Time to serve a request, since the last START.", "", lats, 1e-9);
+    collect_op_stats(stats);
+    collect_table_stats(roots, stats);
+    return format_stats(stats, prometheus);
+}
 
-        const auto end_time = std::chrono::high_resolution_clock::now();
-        dur = std::chrono::duration<double>(end_time - start_time).count();
+void inc_set_count() {
+    ReqStats& r = mine();
+    owner_add(r.sets, 1);
+    owner_add(r.served_sets, 1);
+}
 
-        if (bthread) {
-            bthread->join();
-            delete bthread;
-            bthread = nullptr;
-        }
+void inc_active() {
+    std::atomic<int>& a = mine().active;
+    a.store(a.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
 
-        const std::string metrics = get_metrics();
-        write(admin_fd, metrics.c_str(), metrics.size());
-    }
-}
\ No newline at end of file
+void dec_active_log_lat(const double latency_ms) {
+    ReqStats& r = mine();
+    r.active.store(r.active.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    owner_add(r.total, 1);
+    owner_add(r.served, 1);
+    r.lat_ns.record(static_cast<uint64_t>(latency_ms * 1'000'000.0));
+}
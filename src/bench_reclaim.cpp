@@ -0,0 +1,114 @@
+#include "types.h"
+#include "reclaim.h"
+#include "ops.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+
+// one workload, built once per reclaimer (bench_reclaim_hp / bench_reclaim_ebr)
+// run both on the same box and compare the lines
+
+#ifdef ZOOM_RECLAIM_EBR
+constexpr const char* SCHEME = "ebr";
+#else
+constexpr const char* SCHEME = "hp";
+#endif
+
+using Clock = std::chrono::steady_clock;
+
+struct Mix {
+    const char* name;
+    int get_pct;
+    int set_pct;    // rest are DELs
+};
+
+struct Result {
+    uint64_t ops{0};
+    std::vector<double> lat_ns;
+};
+
+// every 64th op is timed ; keeps the clock out of the throughput number
+constexpr uint64_t SAMPLE_EVERY = 64;
+
+void run(const Mix& mix, const std::vector<std::string>& keys, const int threads, const double seconds) {
+    std::vector<Result> results(threads);
+    std::atomic<bool> go{false}, stop{false};
+    std::vector<std::thread> pool;
+
+    for (int t = 0; t < threads; t++) {
+        pool.emplace_back([&, t] {
+            get_my_hp_index();
+            std::mt19937_64 gen(t + 1);
+            std::uniform_int_distribution<size_t> pick(0, keys.size() - 1);
+            std::uniform_int_distribution<int> pct(0, 99);
+            const std::string value(16, 'v');
+            const std::string long_value(64, 'V');
+            std::string out;
+            auto& r = results[t];
+
+            while (!go.load(acquire)) std::this_thread::yield();
+
+            while (!stop.load(relaxed)) {
+                const auto& k = keys[pick(gen)];
+                const int p = pct(gen);
+                const bool timed = r.ops % SAMPLE_EVERY == 0;
+                const auto t1 = timed ? Clock::now() : Clock::time_point{};
+
+                if (p < mix.get_pct) get(k, out);
+                else if (p < mix.get_pct + mix.set_pct) set(k, (r.ops & 1) ? value : long_value);
+                else del(k);
+
+                if (timed) r.lat_ns.push_back(std::chrono::duration<double, std::nano>(Clock::now() - t1).count());
+                r.ops++;
+            }
+            release_hp_index();
+        });
+    }
+
+    const auto t1 = Clock::now();
+    go.store(true, release);
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop.store(true, relaxed);
+    for (auto& th : pool) th.join();
+    const double elapsed = std::chrono::duration<double>(Clock::now() - t1).count();
+
+    uint64_t ops = 0;
+    std::vector<double> lat;
+    for (auto& r : results) {
+        ops += r.ops;
+        lat.insert(lat.end(), r.lat_ns.begin(), r.lat_ns.end());
+    }
+    std::ranges::sort(lat);
+    auto pct = [&](const double q) { return lat.empty() ? 0.0 : lat[static_cast<size_t>(q * (lat.size() - 1))]; };
+
+    std::cout << std::fixed << "    [" << SCHEME << "] " << std::left << std::setw(10) << mix.name << std::right
+              << std::setprecision(2) << ops / elapsed / 1e6 << " Mops/s | "
+              << std::setprecision(0) << "p50=" << pct(0.50) << " p99=" << pct(0.99)
+              << " p999=" << pct(0.999) << " ns\n";
+}
+
+int main(const int argc, char** argv) {
+    const int threads = argc > 1 ? std::stoi(argv[1]) : static_cast<int>(std::max(2u, std::thread::hardware_concurrency()));
+    const size_t n = argc > 2 ? std::stoul(argv[2]) : 100'000;
+    const double seconds = argc > 3 ? std::stod(argv[3]) : 2.0;
+
+    std::vector<std::string> keys;
+    for (size_t i = 0; i < n; i++) keys.push_back("key_" + std::to_string(i));
+
+    // prefill so GETs mostly hit
+    get_my_hp_index();
+    for (const auto& k : keys) set(k, "value_" + k);
+
+    std::cout << "\n" << SCHEME << " | " << threads << " threads | " << n << " keys | " << seconds << "s per mix\n\n";
+    run({"GET-heavy", 90, 9}, keys, threads, seconds);
+    run({"SET-heavy", 10, 80}, keys, threads, seconds);
+    std::cout << "\n";
+
+    release_hp_index();
+    return 0;
+}
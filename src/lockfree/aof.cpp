@@ -0,0 +1,353 @@
+#include "include/aof.h"
+#include "include/reclaim.h"
+#include "include/ops.h"
+#include "include/hash.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+constexpr size_t AOF_HEAD = 17;
+constexpr size_t AOF_BASE_BUF = 1 << 20;    // rewrite base bytes per write()
+
+// set once by aof_open before any traffic
+static bool aof_enabled = false;
+static string aof_path;
+static AofSync aof_sync = AOF_NONE;
+static int aof_interval_ms = 0;
+static vector<atomic<Table*>*> aof_roots;
+static uint64_t aof_ts_shift = 0;   // keeps stamps past the replayed ones ; steady_clock restarts at boot
+
+// flusher only
+static int aof_fd = -1;
+static size_t aof_size = 0;
+static size_t aof_base_size = 0;    // size right after the last rewrite
+static string rewrite_tail;         // records logged while a rewrite walks
+
+static atomic<uint64_t> commit_req{0};      // bumped by whoever needs a flusher round now
+static atomic<uint64_t> commit_done{0};     // highest commit_req a finished round covered
+static thread_local bool logged = false;    // since this thread's last aof_commit()
+
+// IDLE -> TEE (asked) -> TEEING (flusher copies every round to rewrite_tail) -> BASE_DONE -> IDLE
+enum RewritePhase : int { RW_IDLE, RW_TEE, RW_TEEING, RW_BASE_DONE };
+static atomic<bool> rewrite_running{false};
+static atomic<int> rewrite_phase{RW_IDLE};
+static int rewrite_fd = -1;         // handed to the flusher with RW_BASE_DONE
+
+static uint64_t now_ns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t stamp() {
+    return now_ns() + aof_ts_shift;
+}
+
+static void write_all(const int fd, const char* p, size_t n) {
+    while (n > 0) {
+        const ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) throw std::runtime_error("aof write failed");
+        p += w;
+        n -= w;
+    }
+}
+
+// exp rides in front of the value of an 'E' record
+static void put_record(string& out, const uint64_t ts, const char op, const std::string_view k, const std::string_view v, const uint32_t exp) {
+    char head[AOF_HEAD];
+    const uint32_t klen = k.size(), vlen = v.size() + (op == 'E' ? 4 : 0);
+    std::memcpy(head, &ts, 8);
+    head[8] = op;
+    std::memcpy(head + 9, &klen, 4);
+    std::memcpy(head + 13, &vlen, 4);
+    out.append(head, sizeof(head));
+    out += k;
+    if (op == 'E') out.append(reinterpret_cast<const char*>(&exp), 4);
+    out += v;
+}
+
+static void append(const uint64_t ts, const char op, const std::string_view k, const std::string_view v, const uint32_t exp) {
+    if (!aof_enabled) return;
+    AofBuf& b = aof_bufs[get_my_hp_index()];
+    while (b.lock.test_and_set(acquire)) std::this_thread::yield();
+    put_record(b.data, ts, op, k, v, exp);
+    b.lock.clear(release);
+    logged = true;
+}
+
+uint64_t aof_stamp() {
+    return aof_enabled ? stamp() : 0;
+}
+
+void aof_set(const std::string_view k, const std::string_view v, const uint32_t exp, const uint64_t ts) {
+    append(ts, exp == TTL_NEVER ? 'S' : 'E', k, v, exp);
+}
+
+void aof_del(const std::string_view k, const uint64_t ts) {
+    append(ts, 'D', k, {}, TTL_NEVER);
+}
+
+void aof_wrote_elsewhere() {
+    if (aof_enabled) logged = true;
+}
+
+void aof_commit() {
+    if (aof_sync != AOF_BATCH || !logged) return;
+    logged = false;
+
+    const uint64_t t = commit_req.fetch_add(1, acq_rel) + 1;
+    commit_req.notify_one();
+    uint64_t done;
+    while ((done = commit_done.load(acquire)) < t) commit_done.wait(done, acquire);
+}
+
+// everything every thread has logged so far ; a swap under each lock, the copy outside it
+static void drain(string& chunk) {
+    thread_local string spare;
+    aof_bufs.for_each([&](AofBuf& b) {
+        while (b.lock.test_and_set(acquire)) std::this_thread::yield();
+        b.data.swap(spare);
+        b.lock.clear(release);
+        chunk += spare;
+        spare.clear();
+    });
+}
+
+// the rewritten log replaces the old one : base, then what was logged while it was written
+static void finish_rewrite() {
+    write_all(rewrite_fd, rewrite_tail.data(), rewrite_tail.size());
+    fsync(rewrite_fd);
+    const string tmp = aof_path + ".rewrite";
+    if (rename(tmp.c_str(), aof_path.c_str()) < 0) {
+        std::cerr << "aof: rewrite rename failed" << std::endl;
+        close(rewrite_fd);
+        unlink(tmp.c_str());
+    }
+    else {
+        close(aof_fd);
+        aof_fd = rewrite_fd;
+        aof_size = lseek(aof_fd, 0, SEEK_END);
+        aof_base_size = aof_size;
+    }
+    rewrite_fd = -1;
+    rewrite_tail.clear();
+}
+
+[[noreturn]] static void flusher() {
+    uint64_t seen = 0;
+    auto last_sync = chrono::steady_clock::now();
+    string chunk;
+
+    while (true) {
+        if (aof_sync == AOF_BATCH) commit_req.wait(seen, acquire);
+        else std::this_thread::sleep_for(chrono::milliseconds(AOF_WRITE_MS));
+
+        const uint64_t target = commit_req.load(acquire);
+        seen = target;
+        const int phase = rewrite_phase.load(acquire);
+        if (phase == RW_IDLE && !rewrite_tail.empty()) rewrite_tail.clear();   // a rewrite gave up
+
+        chunk.clear();
+        drain(chunk);
+        try {
+            write_all(aof_fd, chunk.data(), chunk.size());
+        }
+        catch (const std::exception& e) {
+            std::cerr << "aof: " << e.what() << std::endl;
+        }
+        aof_size += chunk.size();
+        if (phase == RW_TEEING || phase == RW_BASE_DONE) rewrite_tail += chunk;
+
+        // whatever this round didn't tee was logged before the walk starts
+        if (phase == RW_TEE) {
+            rewrite_phase.store(RW_TEEING, release);
+            rewrite_phase.notify_all();
+        }
+        if (phase == RW_BASE_DONE) {
+            finish_rewrite();
+            rewrite_phase.store(RW_IDLE, release);
+            rewrite_phase.notify_all();
+        }
+
+        const auto now = chrono::steady_clock::now();
+        if (aof_sync == AOF_BATCH || (aof_sync == AOF_INTERVAL && now - last_sync >= chrono::milliseconds(aof_interval_ms))) {
+            fsync(aof_fd);
+            last_sync = now;
+        }
+        commit_done.store(target, release);
+        commit_done.notify_all();
+
+        if (aof_size >= AOF_REWRITE_MIN && aof_size >= 2 * aof_base_size) aof_rewrite_begin();
+    }
+}
+
+// wakes a flusher that only runs on demand
+static void poke() {
+    commit_req.fetch_add(1, acq_rel);
+    commit_req.notify_one();
+}
+
+static void wait_phase(const int want) {
+    int p;
+    while ((p = rewrite_phase.load(acquire)) != want) rewrite_phase.wait(p, acquire);
+}
+
+struct AofBase : KvSink {
+    int fd;
+    string buf;
+
+    explicit AofBase(const int fd) : fd(fd) {}
+
+    void add(const string& k, const string& v, const uint32_t exp) override {
+        put_record(buf, 0, exp == TTL_NEVER ? 'S' : 'E', k, v, exp);
+        if (buf.size() >= AOF_BASE_BUF) flush();
+    }
+
+    void flush() {
+        write_all(fd, buf.data(), buf.size());
+        buf.clear();
+    }
+};
+
+static void rewrite() {
+    get_my_hp_index();
+    rewrite_phase.store(RW_TEE, release);
+    poke();
+    wait_phase(RW_TEEING);
+
+    const string tmp = aof_path + ".rewrite";
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    try {
+        if (fd < 0) throw std::runtime_error("aof rewrite open failed: " + tmp);
+        AofBase base(fd);
+        walk_roots(aof_roots, base);
+        base.flush();
+
+        rewrite_fd = fd;
+        rewrite_phase.store(RW_BASE_DONE, release);
+        poke();
+        wait_phase(RW_IDLE);
+    }
+    catch (const std::exception& e) {
+        std::cerr << "aof: " << e.what() << std::endl;
+        if (fd >= 0) {
+            close(fd);
+            unlink(tmp.c_str());
+        }
+        rewrite_phase.store(RW_IDLE, release);
+    }
+    release_hp_index();
+}
+
+bool aof_rewrite_begin() {
+    if (!aof_enabled) return false;
+    if (rewrite_running.exchange(true, acq_rel)) return false;
+
+    std::thread([] {
+        rewrite();
+        rewrite_running.store(false, release);
+    }).detach();
+    return true;
+}
+
+// a record where replay found it
+struct AofRec {
+    uint64_t ts;
+    size_t off;
+};
+
+// what put_record can write : a known op, D with no value, E with room for its exp
+static bool valid_record(const char op, const uint32_t vlen) {
+    if (op == 'S') return true;
+    if (op == 'E') return vlen >= 4;
+    if (op == 'D') return vlen == 0;
+    return false;
+}
+
+// records in ts order ; a torn last record from a crash is cut off the file. a record that
+// can't be one before that is corruption : nothing is replayed and the file is left for recovery
+static size_t replay(const int fd, const vector<atomic<Table*>*>& roots, const SnapRoute route, uint64_t& last_ts) {
+    struct stat st{};
+    fstat(fd, &st);
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size == 0) return 0;
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) throw std::runtime_error("aof mmap failed: " + aof_path);
+    const auto* base = static_cast<const char*>(map);
+
+    vector<AofRec> recs;
+    size_t off = 0;
+    while (off + AOF_HEAD <= size) {
+        uint64_t ts;
+        uint32_t klen, vlen;
+        std::memcpy(&ts, base + off, 8);
+        std::memcpy(&klen, base + off + 9, 4);
+        std::memcpy(&vlen, base + off + 13, 4);
+        if (!valid_record(base[off + 8], vlen)) {
+            munmap(map, size);
+            throw std::runtime_error("aof: bad record at offset " + std::to_string(off) + " of " + aof_path + ", file left as is");
+        }
+        if (off + AOF_HEAD + klen + vlen > size) break;
+        recs.push_back({ts, off});
+        off += AOF_HEAD + klen + vlen;
+    }
+    if (off < size) {
+        std::cerr << "aof: dropping " << size - off << " torn bytes at the end of " << aof_path << std::endl;
+        if (ftruncate(fd, off) < 0) throw std::runtime_error("aof truncate failed: " + aof_path);
+    }
+
+    std::ranges::stable_sort(recs, {}, &AofRec::ts);
+    if (!recs.empty()) last_ts = recs.back().ts;
+
+    atomic<Table*>* const mine = my_tb;
+    for (const AofRec& r : recs) {
+        const char* p = base + r.off;
+        uint32_t klen, vlen;
+        std::memcpy(&klen, p + 9, 4);
+        std::memcpy(&vlen, p + 13, 4);
+        const std::string_view k(p + AOF_HEAD, klen);
+        my_tb = roots[route(hash(k))];
+        const char* v = p + AOF_HEAD + klen;
+        if (p[8] == 'S') set(k, std::string_view(v, vlen));
+        else if (p[8] == 'E') {
+            uint32_t exp;
+            std::memcpy(&exp, v, 4);
+            set(k, std::string_view(v + 4, vlen - 4), exp);
+        }
+        else if (p[8] == 'D') del(k);
+    }
+    my_tb = mine;
+
+    munmap(map, size);
+    return recs.size();
+}
+
+size_t aof_open(const string& path, const AofSync sync, const int interval_ms, const vector<atomic<Table*>*>& roots, const SnapRoute route) {
+    aof_path = path;
+    aof_sync = sync;
+    aof_interval_ms = interval_ms;
+    aof_roots = roots;
+
+    aof_fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (aof_fd < 0) throw std::runtime_error("aof open failed: " + path);
+
+    get_my_hp_index();
+    uint64_t last_ts = 0;
+    const size_t replayed = replay(aof_fd, roots, route, last_ts);
+    const uint64_t now = now_ns();
+    if (last_ts >= now) aof_ts_shift = last_ts + 1 - now;
+    aof_size = lseek(aof_fd, 0, SEEK_END);
+    aof_base_size = aof_size;
+
+    aof_enabled = true;
+    std::thread(flusher).detach();
+    return replayed;
+}
@@ -0,0 +1,36 @@
+#include "include/clock.h"
+#include "include/types.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#endif
+
+// cpuid 0x80000007 edx bit 8 : the TSC runs at one rate through P and C states
+static bool probe_invariant() {
+#if defined(__x86_64__) || defined(__i386__)
+    unsigned a, b, c, d;
+    return __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & 1u << 8);
+#elif defined(__aarch64__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+double calibrate_tsc() {
+#if defined(__aarch64__)
+    uint64_t hz;
+    asm volatile("mrs %0, cntfrq_el0" : "=r"(hz));
+    return 1e9 / static_cast<double>(hz);
+#else
+    if (!tsc_invariant) return 1.0;
+    using steady = chrono::steady_clock;
+    const auto w0 = steady::now();
+    const Ticks t0 = ticks();
+    while (steady::now() - w0 < chrono::milliseconds(TSC_CALIBRATE_MS)) {}
+    const auto w1 = steady::now();
+    const Ticks t1 = ticks();
+    return static_cast<double>(chrono::duration_cast<chrono::nanoseconds>(w1 - w0).count()) / static_cast<double>(t1 - t0);
+#endif
+}
+
+const bool tsc_invariant = probe_invariant();
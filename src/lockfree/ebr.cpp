@@ -0,0 +1,93 @@
+#ifdef ZOOM_RECLAIM_EBR
+
+#include "include/ebr.h"
+#include "include/slab.h"
+#include <algorithm>
+#include <thread>
+
+struct Limbo {
+    void* ptr;
+    void (*free)(void*);
+    uint64_t epoch;
+};
+
+atomic<uint64_t> global_epoch{0};
+Registry<Epoch_Slot> epochs;
+static thread_local vector<Limbo> limbo;
+
+int get_my_hp_index() {
+    if (my_hp_index == -1) {
+        const size_t i = epochs.acquire();
+        transition_metrics.ensure(i);
+        spin_metrics.ensure(i);
+        slab_stats.ensure(i);
+        aof_bufs.ensure(i);
+        ttl_bufs.ensure(i);
+        trace_rings.ensure(i);
+        epochs[i].in_use.store(true, release);
+        my_hp_index = static_cast<int>(i);
+    }
+    return my_hp_index;
+}
+
+// every pinned thread has seen the current epoch ; move it on
+static void try_advance() {
+    uint64_t e = global_epoch.load(seq_cst);
+    bool behind = false;
+    epochs.for_each([&](const Epoch_Slot& rec) {
+        if (behind || !rec.in_use.load(acquire)) return;
+        const uint64_t local = rec.local.load(seq_cst);
+        behind = local != IDLE_EPOCH && local != e;
+    });
+    if (!behind) global_epoch.compare_exchange_strong(e, e + 1, seq_cst, relaxed);
+}
+
+void freeScan() {
+    try_advance();
+    const uint64_t e = global_epoch.load(acquire);
+
+    // limbo is in retire order, so epochs only go up
+    size_t n = 0;
+    while (n < limbo.size() && limbo[n].epoch + 2 <= e) {
+        limbo[n].free(limbo[n].ptr);
+        n++;
+    }
+    limbo.erase(limbo.begin(), limbo.begin() + n);
+}
+
+void retire(Blob* ptr) {
+    if (ptr == nullptr) return;
+    limbo.push_back({ptr, [](void* p) { blob_free(static_cast<Blob*>(p)); }, global_epoch.load(seq_cst)});
+    if (limbo.size() >= RETIRED_THRESHOLD) {
+        freeScan();
+    }
+}
+
+static void free_table(void* p) { delete static_cast<Table*>(p); }
+
+// tables don't count toward the threshold ; with inline keys no blobs may follow, so scan now
+void retire(Table* ptr) {
+    if (ptr == nullptr) return;
+    limbo.push_back({ptr, free_table, global_epoch.load(seq_cst)});
+    freeScan();
+}
+
+size_t pending_tables() {
+    return std::ranges::count(limbo, &free_table, &Limbo::free);
+}
+
+void release_hp_index() {
+    epochs[my_hp_index].local.store(IDLE_EPOCH);
+
+    // other threads only pin an epoch for the length of one op
+    while (!limbo.empty()) {
+        std::this_thread::yield();
+        freeScan();
+    }
+    slab_release_cache();
+    epochs[my_hp_index].in_use.store(false);
+    epochs.release(my_hp_index);
+    my_hp_index = -1;
+}
+
+#endif
@@ -1,9 +1,20 @@
 #include "include/types.h"
 
-vector<TransitionMetrics> transition_metrics(MAX_THREADS);
-vector<HP_Slot> hp(MAX_THREADS);
-vector<TB_slot> tb(MAX_KEYS);
-vector<SpinMetrics> spin_metrics(MAX_THREADS);
+Registry<TransitionMetrics> transition_metrics;
+Registry<SlabStats> slab_stats;
+Registry<AofBuf> aof_bufs;
+Registry<TtlBuf> ttl_bufs;
+Registry<TraceRing> trace_rings;
+Registry<HP_Slot> hp;
+atomic<int> active_hp_threads{0};
+atomic<Table*> tb{new Table(INIT_CAPACITY, &tb)};
+Registry<SpinMetrics> spin_metrics;
+alignas(64) atomic<uint32_t> ttl_now{0};
+size_t mem_budget = 0;
+alignas(64) atomic<int64_t> kv_bytes{0};
+alignas(64) atomic<bool> trace_on{false};
 
-thread_local vector<string*> retired_list;
-thread_local int my_hp_index = -1;
\ No newline at end of file
+thread_local vector<Blob*> retired_list;
+thread_local vector<Table*> retired_tables;
+thread_local int my_hp_index = -1;
+thread_local atomic<Table*>* my_tb = &tb;
\ No newline at end of file
@@ -1,17 +1,31 @@
+#ifndef ZOOM_RECLAIM_EBR
+
 #include "include/hp.h"
+#include "include/slab.h"
+#include <algorithm>
+#include <utility>
+
+// retired nodes left behind by exiting threads ; the next scan adopts them
+struct Orphans {
+    vector<Blob*> blobs;
+    vector<Table*> tables;
+    Orphans* next{nullptr};
+};
 
-using std::runtime_error;
+static atomic<Orphans*> orphans{nullptr};
 
 int get_my_hp_index() {
     if (my_hp_index == -1) {
-        for (int i = 0; i < MAX_THREADS; i++) {
-            bool expected = false;
-            if (hp[i].in_use.compare_exchange_strong(expected, true, acq_rel, relaxed)) {
-                my_hp_index = i;
-                return i;
-            }
-        }
-        throw runtime_error("No HP slots available");
+        const size_t i = hp.acquire();
+        transition_metrics.ensure(i);
+        spin_metrics.ensure(i);
+        slab_stats.ensure(i);
+        aof_bufs.ensure(i);
+        ttl_bufs.ensure(i);
+        trace_rings.ensure(i);
+        hp[i].in_use.store(true, release);
+        my_hp_index = static_cast<int>(i);
+        active_hp_threads.fetch_add(1, relaxed);
     }
     return my_hp_index;
 }
@@ -25,31 +39,104 @@ void clear_hp_both() {
     hp[my_hp_index].slot[V].store(nullptr, relaxed);
 }
 
-bool can_delete(const void* ptr) {
-    for (int i = 0; i < MAX_THREADS; i++) {
-        if (!hp[i].in_use.load(acquire)) continue;
-        if (hp[i].slot[K].load(acquire) == ptr) return false;
-        if (hp[i].slot[V].load(acquire) == ptr) return false;
+// every published hazard, once per scan ; sorted for binary search
+static thread_local vector<const void*> hazards;
+
+static void snapshot_hazards() {
+    hazards.clear();
+    hp.for_each([](const HP_Slot& rec) {
+        if (!rec.in_use.load(acquire)) return;
+        for (const auto& slot : rec.slot) {
+            const void* ptr = slot.load(acquire);
+            if (ptr != nullptr) hazards.push_back(ptr);
+        }
+    });
+    std::ranges::sort(hazards);
+}
+
+static bool is_hazard(const void* ptr) {
+    return std::ranges::binary_search(hazards, ptr);
+}
+
+static void dispose(Blob* b) { blob_free(b); }
+static void dispose(Table* t) { delete t; }
+
+// frees what nobody holds ; keeps the rest in place, one pass per list
+template<typename Ptr>
+static void free_unprotected(vector<Ptr*>& list) {
+    size_t keep = 0;
+    for (Ptr* ptr : list) {
+        if (is_hazard(ptr)) list[keep++] = ptr;
+        else dispose(ptr);
     }
-    return true;
+    list.resize(keep);
 }
 
-void freeScan() {
-    auto ptr = retired_list.begin();
-    while (ptr != retired_list.end()) {
-        if (can_delete(*ptr)) {
-            delete *ptr;
-            ptr = retired_list.erase(ptr);
-        } else {
-            ++ptr;
-        }
+// at most 3 hazards per active thread survive a scan ; scanning at twice that
+// frees at least half the list, so each retire pays O(1) amortized
+static size_t retire_threshold() {
+    const size_t held = 3 * static_cast<size_t>(active_hp_threads.load(relaxed));
+    return std::max(static_cast<size_t>(RETIRED_THRESHOLD), 2 * held);
+}
+
+static void adopt_orphans() {
+    if (orphans.load(relaxed) == nullptr) return;
+    Orphans* o = orphans.exchange(nullptr, acquire);
+    while (o != nullptr) {
+        retired_list.insert(retired_list.end(), o->blobs.begin(), o->blobs.end());
+        retired_tables.insert(retired_tables.end(), o->tables.begin(), o->tables.end());
+        delete std::exchange(o, o->next);
     }
 }
 
-void retire(string* ptr) {
+void freeScan() {
+    adopt_orphans();
+    snapshot_hazards();
+    free_unprotected(retired_list);
+    free_unprotected(retired_tables);
+}
+
+void retire(Blob* ptr) {
     if (ptr == nullptr) return;
     retired_list.push_back(ptr);
-    if (retired_list.size() >= RETIRED_THRESHOLD) {
+    if (retired_list.size() >= retire_threshold()) {
         freeScan();
     }
-}
\ No newline at end of file
+}
+
+// a table is as big as the keys it held ; scan now rather than wait on blobs,
+// which inline keys and values never retire
+void retire(Table* ptr) {
+    if (ptr == nullptr) return;
+    retired_tables.push_back(ptr);
+    freeScan();
+}
+
+size_t pending_tables() {
+    return retired_tables.size();
+}
+
+void release_hp_index() {
+    hp[my_hp_index].slot[K].store(nullptr);
+    hp[my_hp_index].slot[V].store(nullptr);
+    hp[my_hp_index].slot[T].store(nullptr);
+    freeScan();
+
+    // still held by someone ; hand them to whoever scans next
+    if (!retired_list.empty() || !retired_tables.empty()) {
+        auto* o = new Orphans{std::move(retired_list), std::move(retired_tables)};
+        retired_list.clear();
+        retired_tables.clear();
+        o->next = orphans.load(relaxed);
+        while (!orphans.compare_exchange_weak(o->next, o, release, relaxed)) {}
+    }
+
+    slab_release_cache();
+
+    hp[my_hp_index].in_use.store(false);
+    active_hp_threads.fetch_sub(1, relaxed);
+    hp.release(my_hp_index);
+    my_hp_index = -1;
+}
+
+#endif
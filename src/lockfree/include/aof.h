@@ -0,0 +1,42 @@
+#pragma once
+
+#include "types.h"
+#include "snapshot.h"
+#include <string>
+#include <string_view>
+
+// append-only log of writes ; each thread appends to its own buffer (aof_bufs) and a single
+// flusher thread writes them all out, so set()/del() never wait on the disk
+//
+//   record : uint64 ts | uint8 op ('S', 'E' or 'D') | uint32 klen | uint32 vlen | key | value
+//   an 'E' set has a deadline : its value is uint32 exp, then the value proper
+//
+// set() and del() log themselves. ts is steady clock ns taken while the write still owns its
+// slot, and replay applies records in ts order, so two writes to one key replay in the order
+// the table took them. a rewrite's base records have ts 0
+enum AofSync : uint8_t {
+    AOF_NONE,       // write each round, leave fsync to the kernel
+    AOF_INTERVAL,   // fsync every interval_ms
+    AOF_BATCH,      // aof_commit() waits for an fsync covering everything its thread logged
+};
+
+// replays path into roots[route(h)] if it exists, then appends to it and starts the flusher
+// roots must not be serving yet ; rewrites walk them later. returns the records replayed
+size_t aof_open(const string& path, AofSync sync, int interval_ms, const vector<atomic<Table*>*>& roots, SnapRoute route);
+
+// the write's ts, taken by set()/del() before they release the slot ; 0 until aof_open()
+uint64_t aof_stamp();
+
+// no-ops until aof_open()
+void aof_set(std::string_view k, std::string_view v, uint32_t exp, uint64_t ts);
+void aof_del(std::string_view k, uint64_t ts);
+
+// a write this thread had a shard owner make ; aof_commit() waits for it like its own
+void aof_wrote_elsewhere();
+
+// under AOF_BATCH blocks until this thread's records are on disk, else returns at once
+// one fsync covers every thread waiting at the time (group commit)
+void aof_commit();
+
+// rewrites the log from the tables in the background ; false if one is running or there's no log
+bool aof_rewrite_begin();
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "types.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+// exponential pause backoff ; once spent, callers park instead of spinning
+struct Backoff {
+    int pauses{1};
+
+    void operator()() {
+        for (int i = 0; i < pauses; i++) cpu_relax();
+        if (pauses < SPIN_PAUSE_MAX) pauses <<= 1;
+    }
+
+    bool spent() const { return pauses >= SPIN_PAUSE_MAX; }
+};
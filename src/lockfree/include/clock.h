@@ -0,0 +1,39 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// cycle counter for timing the op hot path : rdtsc on x86, cntvct_el0 on arm64. either is a
+// few ns to read against tens for a clock call, and both tick at a fixed rate on every core
+// where the TSC is invariant (cpuid says so) ; elsewhere ticks are steady_clock ns
+// ticks_to_ns() scales by a rate taken on its first call : calibrated against steady_clock over
+// TSC_CALIBRATE_MS on x86, read off cntfrq_el0 on arm64. so a binary that never converts never spins
+
+using Ticks = uint64_t;
+
+extern const bool tsc_invariant;
+
+double calibrate_tsc();
+
+inline double ns_per_tick() {
+    static const double rate = calibrate_tsc();
+    return rate;
+}
+
+inline Ticks ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    if (tsc_invariant) return __rdtsc();
+#elif defined(__aarch64__)
+    Ticks v;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#endif
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint64_t ticks_to_ns(const Ticks t) {
+    return static_cast<uint64_t>(static_cast<double>(t) * ns_per_tick());
+}
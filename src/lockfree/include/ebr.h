@@ -0,0 +1,48 @@
+#pragma once
+
+#include "types.h"
+#include <atomic>
+#include <stdexcept>
+
+// epoch based reclamation ; same surface as hp.h, picked with ZOOM_RECLAIM_EBR
+// an op pins the global epoch once instead of publishing every pointer it reads
+// anything retired is freed once the epoch has moved on twice
+
+constexpr uint64_t IDLE_EPOCH = ~0ull;
+
+struct alignas(64) Epoch_Slot {
+    atomic<uint64_t> local{IDLE_EPOCH};
+    atomic<bool> in_use{false};
+};
+
+extern atomic<uint64_t> global_epoch;
+extern Registry<Epoch_Slot> epochs;
+
+int get_my_hp_index();
+void freeScan();
+void retire(Blob* ptr);
+void retire(Table* ptr);
+void release_hp_index();
+size_t pending_tables();     // retired by this thread, not yet freed
+
+// nothing to publish ; the pinned epoch covers every read in the op
+inline void hazard(int, void*) {}
+inline void clear_hp(int) {}
+inline void clear_hp_both() {}
+
+template<typename T>
+T* protect(std::atomic<T*>& container, int) {
+    return container.load(acquire);
+}
+
+// one per op ; pins the epoch for its lifetime
+struct OpGuard {
+    OpGuard() {
+        epochs[my_hp_index].local.store(global_epoch.load(relaxed), relaxed);
+        std::atomic_thread_fence(seq_cst);
+    }
+
+    ~OpGuard() {
+        epochs[my_hp_index].local.store(IDLE_EPOCH, release);
+    }
+};
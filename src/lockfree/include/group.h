@@ -0,0 +1,131 @@
+#pragma once
+
+#include "types.h"
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// ctrl : one byte per slot, a hint next to TB_slot::s ; s stays the truth
+//        EMPTY never used | DELETED D or M | 0x80 | 7 hash bits while keyed
+constexpr uint8_t CTRL_EMPTY = 0x00;
+constexpr uint8_t CTRL_DELETED = 0x01;
+
+inline uint8_t tag_of(const size_t h) {
+    return 0x80 | static_cast<uint8_t>((h * 0x9E3779B97F4A7C15ull) >> 57);
+}
+
+// slot offsets of the set bits, lowest first
+template<int Shift>
+struct BitMask {
+    uint64_t bits;
+
+    struct iterator {
+        uint64_t b;
+        size_t operator*() const { return std::countr_zero(b) >> Shift; }
+        iterator& operator++() { b &= b - 1; return *this; }
+        bool operator!=(const iterator& o) const { return b != o.b; }
+    };
+
+    iterator begin() const { return {bits}; }
+    iterator end() const { return {0}; }
+};
+
+#if defined(__AVX2__)
+
+constexpr size_t GROUP_WIDTH = 32;
+
+struct Group {
+    __m256i ctrl;
+
+    // racy snapshot of the ctrl bytes ; every hit is re-checked against s
+    explicit Group(const atomic<uint8_t>* p)
+        : ctrl(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p))) {}
+
+    BitMask<0> match(const uint8_t tag) const {
+        const __m256i eq = _mm256_cmpeq_epi8(ctrl, _mm256_set1_epi8(static_cast<char>(tag)));
+        return {static_cast<uint32_t>(_mm256_movemask_epi8(eq))};
+    }
+
+    BitMask<0> match_empty() const { return match(CTRL_EMPTY); }
+
+    // high bit clear : EMPTY or DELETED
+    BitMask<0> match_free() const {
+        return {~static_cast<uint32_t>(_mm256_movemask_epi8(ctrl))};
+    }
+};
+
+#elif defined(__SSE2__)
+
+constexpr size_t GROUP_WIDTH = 16;
+
+struct Group {
+    __m128i ctrl;
+
+    // racy snapshot of the ctrl bytes ; every hit is re-checked against s
+    explicit Group(const atomic<uint8_t>* p)
+        : ctrl(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p))) {}
+
+    BitMask<0> match(const uint8_t tag) const {
+        const __m128i eq = _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(tag)));
+        return {static_cast<uint16_t>(_mm_movemask_epi8(eq))};
+    }
+
+    BitMask<0> match_empty() const { return match(CTRL_EMPTY); }
+
+    // high bit clear : EMPTY or DELETED
+    BitMask<0> match_free() const {
+        return {static_cast<uint16_t>(~_mm_movemask_epi8(ctrl))};
+    }
+};
+
+#else
+
+// portable 8-wide fallback (arm64 etc.) ; one bit per byte at bit 7
+constexpr size_t GROUP_WIDTH = 8;
+
+struct Group {
+    static constexpr uint64_t LSB = 0x0101010101010101ull;
+    static constexpr uint64_t MSB = 0x8080808080808080ull;
+    uint64_t ctrl;
+
+    // racy snapshot of the ctrl bytes ; every hit is re-checked against s
+    explicit Group(const atomic<uint8_t>* p) { std::memcpy(&ctrl, p, sizeof(ctrl)); }
+
+    // may flag a byte just above a real hit ; callers re-check anyway
+    BitMask<3> match(const uint8_t tag) const {
+        const uint64_t x = ctrl ^ (LSB * tag);
+        return {(x - LSB) & ~x & MSB};
+    }
+
+    BitMask<3> match_empty() const { return match(CTRL_EMPTY); }
+
+    // high bit clear : EMPTY or DELETED
+    BitMask<3> match_free() const { return {~ctrl & MSB}; }
+};
+
+#endif
+
+static_assert(sizeof(atomic<uint8_t>) == 1);
+static_assert(INIT_CAPACITY % GROUP_WIDTH == 0);
+
+// a truly empty slot ends every probe chain through this group
+inline bool ends_chain(const Table* t, const size_t base, const Group& grp) {
+    for (const size_t b : grp.match_empty()) {
+        if (t->slots[base + b].s.load(acquire) == 'E') return true;
+    }
+    return false;
+}
+
+// first E/D slot of the group, or t->cap
+inline size_t first_free(const Table* t, const size_t base, const Group& grp) {
+    for (const size_t b : grp.match_free()) {
+        const char Si = t->slots[base + b].s.load(acquire);
+        if (Si == 'E' || Si == 'D') return base + b;
+    }
+    return t->cap;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#elif defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+// key hash policies ; one 64-bit hash feeds the home group, the step and the tag
+// pick one at build time with -DZOOM_HASH=<policy> (see bench_hash for numbers)
+
+namespace hashing {
+
+inline uint64_t read64(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t mum(const uint64_t a, const uint64_t b) {
+    const __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+}
+
+// the old home-slot hash ; byte at a time
+struct Legacy31 {
+    static constexpr const char* name = "legacy x31";
+
+    uint64_t operator()(const std::string_view key) const {
+        uint64_t h = 0;
+        for (const char c : key) h = h * 31 + c;
+        return h;
+    }
+};
+
+// the old step hash ; byte at a time
+struct Djb2 {
+    static constexpr const char* name = "djb2";
+
+    uint64_t operator()(const std::string_view key) const {
+        uint64_t h = 5381;
+        for (const char c : key) h = ((h << 5) + h) ^ c;
+        return h;
+    }
+};
+
+// wyhash style ; 16 bytes per round through a 64x64->128 multiply
+struct WyHash {
+    static constexpr const char* name = "wyhash";
+    static constexpr uint64_t S0 = 0xa0761d6478bd642full;
+    static constexpr uint64_t S1 = 0xe7037ed1a0b428dbull;
+
+    uint64_t operator()(const std::string_view key) const {
+        using namespace hashing;
+        const char* p = key.data();
+        const size_t len = key.size();
+        uint64_t seed = S0 ^ len;
+        uint64_t a = 0, b = 0;
+
+        if (len <= 16) {
+            if (len >= 4) {
+                const size_t mid = (len >> 3) << 2;
+                a = (read32(p) << 32) | read32(p + mid);
+                b = (read32(p + len - 4) << 32) | read32(p + len - 4 - mid);
+            } else if (len > 0) {
+                const auto* u = reinterpret_cast<const unsigned char*>(p);
+                a = (static_cast<uint64_t>(u[0]) << 16) | (static_cast<uint64_t>(u[len >> 1]) << 8) | u[len - 1];
+            }
+        } else {
+            size_t i = len;
+            while (i > 16) {
+                seed = mum(read64(p) ^ S1, read64(p + 8) ^ seed);
+                p += 16;
+                i -= 16;
+            }
+            a = read64(p + i - 16);
+            b = read64(p + i - 8);
+        }
+        return mum(S1 ^ len, mum(a ^ S1, b ^ seed));
+    }
+};
+
+#if defined(__SSE4_2__) || defined(__ARM_FEATURE_CRC32)
+
+// hardware crc32c over 8-byte words, spread to 64 bits
+struct Crc32Hash {
+    static constexpr const char* name = "crc32c";
+
+    static uint32_t crc64(const uint32_t c, const uint64_t w) {
+#if defined(__SSE4_2__)
+        return static_cast<uint32_t>(_mm_crc32_u64(c, w));
+#else
+        return __crc32cd(c, w);
+#endif
+    }
+
+    static uint32_t crc8(const uint32_t c, const uint8_t b) {
+#if defined(__SSE4_2__)
+        return _mm_crc32_u8(c, b);
+#else
+        return __crc32cb(c, b);
+#endif
+    }
+
+    uint64_t operator()(const std::string_view key) const {
+        const char* p = key.data();
+        size_t len = key.size();
+        uint32_t c = 0xFFFFFFFFu ^ static_cast<uint32_t>(len);
+
+        for (; len >= 8; p += 8, len -= 8) c = crc64(c, hashing::read64(p));
+        for (; len > 0; p++, len--) c = crc8(c, static_cast<uint8_t>(*p));
+
+        const uint64_t h = (static_cast<uint64_t>(c) << 32 | c) * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+};
+
+#endif
+
+#ifndef ZOOM_HASH
+#define ZOOM_HASH WyHash
+#endif
+
+using KeyHash = ZOOM_HASH;
+
+inline uint64_t hash(const std::string_view key) {
+    return KeyHash{}(key);
+}
+
+// odd, so it walks every group of a power-of-two table
+inline size_t step_of(const uint64_t h) {
+    return static_cast<size_t>(h >> 32) | 1;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+// log-linear histogram of non-negative integers, HdrHistogram style : fixed size, O(1) record,
+// never allocates. below HIST_SUB every value has a bucket of its own ; past it each power of two
+// is cut into HIST_SUB buckets, so a percentile is off by at most 1 / (2 * HIST_SUB) of itself
+// one writer, the owning thread ; anyone may read or merge it at any time
+constexpr int HIST_SUB_BITS = 5;
+constexpr int HIST_MAX_BITS = 40;      // anything from 2^40 up shares the top bucket ; in ns that's 18 minutes
+constexpr size_t HIST_SUB = size_t{1} << HIST_SUB_BITS;
+constexpr size_t HIST_BUCKETS = (HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB;
+
+// single writer add ; a plain load and store, no locked instruction
+inline void owner_add(std::atomic<uint64_t>& a, const uint64_t d) {
+    a.store(a.load(std::memory_order_relaxed) + d, std::memory_order_relaxed);
+}
+
+struct Hist {
+    std::atomic<uint64_t> counts[HIST_BUCKETS]{};
+    std::atomic<uint64_t> n{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<uint64_t> lo{UINT64_MAX};
+    std::atomic<uint64_t> hi{0};
+
+    static size_t bucket_of(const uint64_t v) {
+        if (v < HIST_SUB) return v;
+        const int shift = std::bit_width(v) - HIST_SUB_BITS - 1;
+        return std::min((shift + 1) * HIST_SUB + (v >> shift) - HIST_SUB, HIST_BUCKETS - 1);
+    }
+
+    // middle of bucket i
+    static uint64_t value_of(const size_t i) {
+        if (i < HIST_SUB) return i;
+        const int shift = static_cast<int>(i / HIST_SUB) - 1;
+        return ((i % HIST_SUB + HIST_SUB) << shift) + ((uint64_t{1} << shift) >> 1);
+    }
+
+    // owner only
+    void record(const uint64_t v) {
+        owner_add(counts[bucket_of(v)], 1);
+        owner_add(n, 1);
+        owner_add(sum, v);
+        if (v < lo.load(std::memory_order_relaxed)) lo.store(v, std::memory_order_relaxed);
+        if (v > hi.load(std::memory_order_relaxed)) hi.store(v, std::memory_order_relaxed);
+    }
+
+    // owner only ; readers may see it half cleared
+    void clear() {
+        for (auto& c : counts) c.store(0, std::memory_order_relaxed);
+        n.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        lo.store(UINT64_MAX, std::memory_order_relaxed);
+        hi.store(0, std::memory_order_relaxed);
+    }
+
+    // into a histogram nobody else writes
+    void merge(const Hist& o) {
+        for (size_t i = 0; i < HIST_BUCKETS; i++) owner_add(counts[i], o.counts[i].load(std::memory_order_relaxed));
+        owner_add(n, o.n.load(std::memory_order_relaxed));
+        owner_add(sum, o.sum.load(std::memory_order_relaxed));
+        lo.store(std::min(lo.load(std::memory_order_relaxed), o.lo.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+        hi.store(std::max(hi.load(std::memory_order_relaxed), o.hi.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return n.load(std::memory_order_relaxed); }
+    uint64_t total() const { return sum.load(std::memory_order_relaxed); }
+    uint64_t min() const { return count() == 0 ? 0 : lo.load(std::memory_order_relaxed); }
+    uint64_t max() const { return hi.load(std::memory_order_relaxed); }
+    double mean() const { return count() == 0 ? 0 : static_cast<double>(total()) / count(); }
+
+    // p in [0, 100] ; exact min and max bound it. a read racing the writer may see counts, n and
+    // min/max a few records apart
+    uint64_t percentile(const double p) const {
+        const uint64_t c = count();
+        if (c == 0) return 0;
+        const auto rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(p / 100.0 * c)));
+        const uint64_t l = min(), h = max();
+        uint64_t seen = 0;
+        for (size_t i = 0; i < HIST_BUCKETS; i++) {
+            seen += counts[i].load(std::memory_order_relaxed);
+            if (seen < rank) continue;
+            return l <= h ? std::clamp(value_of(i), l, h) : value_of(i);
+        }
+        return h;
+    }
+};
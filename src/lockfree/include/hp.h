@@ -11,9 +11,25 @@ T* protect(std::atomic<T*>& container, int idx);
 
 void clear_hp(int idx);
 void clear_hp_both();
-bool can_delete(const void* ptr);
 void freeScan();
-void retire(std::string* ptr);
+void retire(Blob* ptr);
+void retire(Table* ptr);
+void release_hp_index();
+size_t pending_tables();     // retired by this thread, not yet freed
+
+// publish ptr ; the caller re-validates where it read it from
+inline void hazard(const int idx, void* ptr) {
+    hp[my_hp_index].slot[idx].store(ptr, release);
+    std::atomic_thread_fence(seq_cst);
+}
+
+// one per op ; drops every hazard on the way out
+struct OpGuard {
+    ~OpGuard() {
+        clear_hp_both();
+        clear_hp(T);
+    }
+};
 
 template<typename T>
 T* protect(std::atomic<T*>& container, const int idx) {
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "types.h"
+#include "clock.h"
+#include "metrics.h"
+#include "trace.h"
+
+// what set() and del() record about their slot transitions, as a policy they're templated on
+//   Instrumented  stamps each transition and spin with ticks() and hands them to the metrics
+//                 (log_transition, log_spins) and the tracer
+//   Bare          records nothing ; its stamps are empty, so every clock read and call goes
+//                 away at compile time and the reports show no spins or transitions
+// ZOOM_INSTRUMENT picks the build's OpInstr ; CMake turns it on unless told otherwise
+
+struct Instrumented {
+    using Stamp = Ticks;
+
+    static Stamp now() { return ticks(); }
+
+    static void transition(const TransitionType type, const Stamp start, const Stamp end, const size_t slot, const int spins) {
+        log_transition(type, start, end, slot, spins);
+    }
+
+    // a wait on a busy slot, got or given up on
+    static void spun(const Stamp start, const Stamp end, const int spins, const int parks, const bool success, const size_t slot) {
+        log_spins(spins, parks, ticks_to_ns(end - start), success);
+        trace(TRACE_SPIN, slot, start, end, spins);
+    }
+};
+
+struct Bare {
+    struct Stamp {};
+
+    static Stamp now() { return {}; }
+    static void transition(TransitionType, Stamp, Stamp, size_t, int) {}
+    static void spun(Stamp, Stamp, int, int, bool, size_t) {}
+};
+
+#ifdef ZOOM_INSTRUMENT
+using OpInstr = Instrumented;
+#else
+using OpInstr = Bare;
+#endif
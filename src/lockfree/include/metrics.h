@@ -1,10 +1,34 @@
 #pragma once
 
 #include "types.h"
+#include "clock.h"
 #include <string>
 
-void log_transition(TransitionType type, TimePoint start, TimePoint end);
-void log_spins(int spins, int cooldowns, double spin_time_ms, bool success);
+// slot and spins only go to the tracer
+void log_transition(TransitionType type, Ticks start, Ticks end, size_t slot, int spins);
+void log_spins(int spins, int parks, uint64_t spin_ns, bool success);
 std::string format_number(double num);
 std::string get_spin_metrics(int total_set_ops);
-std::string get_transition_metrics();
\ No newline at end of file
+std::string get_transition_metrics();
+// one live reading for STATS and /metrics ; family is the Prometheus name, suffix is "" or a
+// summary's _sum / _count, labels go between the braces as they are
+struct Stat {
+    const char* family;
+    const char* type;       // counter, gauge or summary
+    const char* help;
+    const char* suffix;
+    string labels;
+    double value;
+};
+
+// p50 .. p999 of h, then its _sum and _count, all times scale ; labels ahead of quantile=
+void add_summary(vector<Stat>& out, const char* family, const char* help, const string& labels, const Hist& h, double scale);
+
+// spins and transitions, cumulative since the process started
+void collect_op_stats(vector<Stat>& out);
+
+// occupancy of each root's current table, and the memory budget ; takes a reclamation record
+void collect_table_stats(const vector<atomic<Table*>*>& roots, vector<Stat>& out);
+
+// "name{labels} value" lines ; prometheus adds the HELP and TYPE lines before each family
+string format_stats(const vector<Stat>& stats, bool prometheus);
@@ -2,12 +2,26 @@
 
 #include "types.h"
 #include <string>
+#include <string_view>
 #include <cstddef>
+#include <cstdint>
+#include <vector>
 
-size_t hash(const std::string& key);
-size_t hash2(const std::string& key);
+// views in, so a parser can hand over slices of its read buffer ; strings convert for free
+bool get(std::string_view kB, std::string& out);
+void set(std::string_view kA, std::string_view vA);
+void del(std::string_view kx);
 
-void key_deleted_during_spin(bool did_spin, int spin_count, int cooldowns_hit, TimePoint spin_start);
-std::string* get(const std::string& kB);
-void set(const std::string& kA, const std::string& vA);
-void del(const std::string& kx);
\ No newline at end of file
+// exp is the unix second kA expires at (see ttl.h) ; a plain set() clears it
+void set(std::string_view kA, std::string_view vA, uint32_t exp);
+
+// deletes kx only if it expires by now ; the expiry thread's delete
+void del_expired(std::string_view kx, uint32_t now);
+
+// many keys per call ; hashes and prefetches a window of keys before probing any of them
+size_t mget(const std::vector<std::string>& keys, std::vector<std::string>& vals, std::vector<uint8_t>& found);
+void mset(const std::vector<std::string>& keys, const std::vector<std::string>& vals);
+void mdel(const std::vector<std::string>& keys);
+size_t mget(const std::vector<std::string_view>& keys, std::vector<std::string>& vals, std::vector<uint8_t>& found);
+void mset(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& vals);
+void mdel(const std::vector<std::string_view>& keys);
@@ -0,0 +1,10 @@
+#pragma once
+
+// memory reclamation for the table : hazard pointers, or epochs with ZOOM_RECLAIM_EBR
+// both give protect/hazard/clear_hp/retire and an OpGuard held for each op
+
+#ifdef ZOOM_RECLAIM_EBR
+#include "ebr.h"
+#else
+#include "hp.h"
+#endif
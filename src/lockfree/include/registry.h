@@ -0,0 +1,91 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+// grow-only array of per-thread records, addressed by a small index
+// chunk c holds BASE << c records and is never moved or freed, so a reference stays good
+// acquire() reuses released indices first (lock-free stack), then grows
+template<typename R>
+class Registry {
+    static constexpr size_t BASE = 64;
+    static constexpr int CHUNKS = 26;   // BASE << 26 records ; no practical cap
+
+    struct Cell {
+        R rec;
+        std::atomic<uint32_t> next_free{0};   // index + 1 ; 0 ends the stack
+    };
+
+    std::atomic<Cell*> chunks[CHUNKS]{};
+    std::atomic<size_t> high{0};          // records that exist
+    std::atomic<size_t> next_id{0};       // next never-used index
+    std::atomic<uint64_t> free_head{0};   // aba tag << 32 | index + 1
+
+    static int chunk_of(const size_t i) { return std::bit_width(i / BASE + 1) - 1; }
+    static size_t chunk_start(const int c) { return BASE * ((size_t{1} << c) - 1); }
+
+    Cell& cell(const size_t i) {
+        const int c = chunk_of(i);
+        return chunks[c].load(std::memory_order_acquire)[i - chunk_start(c)];
+    }
+
+public:
+    Registry() = default;
+    Registry(const Registry&) = delete;
+    Registry& operator=(const Registry&) = delete;
+
+    ~Registry() {
+        for (auto& c : chunks) delete[] c.load(std::memory_order_relaxed);
+    }
+
+    // owner of i (or anyone past ensure(i)) only
+    R& operator[](const size_t i) { return cell(i).rec; }
+
+    // make record i exist ; side tables use this to follow another registry's indices
+    void ensure(const size_t i) {
+        const int c = chunk_of(i);
+        if (chunks[c].load(std::memory_order_acquire) == nullptr) {
+            Cell* fresh = new Cell[BASE << c];
+            Cell* expected = nullptr;
+            if (!chunks[c].compare_exchange_strong(expected, fresh, std::memory_order_acq_rel)) delete[] fresh;
+        }
+        size_t h = high.load(std::memory_order_relaxed);
+        while (h <= i && !high.compare_exchange_weak(h, i + 1, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    size_t acquire() {
+        uint64_t head = free_head.load(std::memory_order_acquire);
+        while (static_cast<uint32_t>(head) != 0) {
+            const size_t i = static_cast<uint32_t>(head) - 1;
+            const uint64_t next = ((head >> 32) + 1) << 32 | cell(i).next_free.load(std::memory_order_relaxed);
+            if (free_head.compare_exchange_weak(head, next, std::memory_order_acq_rel, std::memory_order_acquire)) return i;
+        }
+
+        const size_t i = next_id.fetch_add(1, std::memory_order_relaxed);
+        ensure(i);
+        return i;
+    }
+
+    void release(const size_t i) {
+        uint64_t head = free_head.load(std::memory_order_relaxed);
+        do {
+            cell(i).next_free.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+        } while (!free_head.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (i + 1),
+                                                  std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    // every record that may be in use ; records are default constructed until claimed
+    template<typename F>
+    void for_each(F&& f) {
+        const size_t n = high.load(std::memory_order_acquire);
+        for (int c = 0; c < CHUNKS && chunk_start(c) < n; c++) {
+            Cell* chunk = chunks[c].load(std::memory_order_acquire);
+            if (chunk == nullptr) continue;
+            const size_t len = std::min(BASE << c, n - chunk_start(c));
+            for (size_t j = 0; j < len; j++) f(chunk[j].rec);
+        }
+    }
+};
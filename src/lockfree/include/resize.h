@@ -0,0 +1,14 @@
+#pragma once
+
+#include "types.h"
+
+struct Packed;
+
+Table* protect_table();
+bool advance(Table*& t);
+void start_resize(Table* t);
+void help_migrate(Table* t, Table* n);
+
+// k/v (already owned) and its deadline into n under hash h, unless n already holds k ; then
+// false and the caller still owns any long k/v. resize copies with it, bulk loads fill with it
+bool place(Table* n, uint64_t h, const Packed& pk, const Packed& pv, uint32_t exp);
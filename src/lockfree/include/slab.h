@@ -0,0 +1,30 @@
+#pragma once
+
+#include "types.h"
+#include <array>
+#include <string>
+#include <string_view>
+
+// out-of-line key or value : header then bytes, in one size-class block
+struct Blob {
+    uint32_t len;
+    uint8_t cls;    // index into SLAB_SIZES, or SLAB_CLASSES for a plain heap block
+
+    char* data() { return reinterpret_cast<char*>(this + 1); }
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    std::string_view view() const { return {data(), len}; }
+};
+
+static_assert(sizeof(Blob) == 8);
+
+// block sizes, header included ; anything shorter than INLINE_MAX never gets here
+constexpr std::array<uint32_t, SLAB_CLASSES> SLAB_SIZES{
+    48, 64, 80, 96, 112, 128, 160, 192, 256, 320, 384, 512, 768, 1024, 1536, 2048
+};
+
+static_assert(SLAB_SIZES.front() >= sizeof(Blob) + INLINE_MAX + 1);
+
+Blob* blob_new(std::string_view src);
+void blob_free(Blob* b);
+void slab_release_cache();
+std::string get_slab_metrics();
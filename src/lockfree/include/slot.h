@@ -0,0 +1,161 @@
+#pragma once
+
+#include "types.h"
+#include "reclaim.h"
+#include "slab.h"
+#include <cstring>
+#include <string_view>
+
+// a key or value as it sits in a slot : inline bytes, or a heap string
+struct Packed {
+    uint8_t n{0};
+    uint64_t w[INLINE_WORDS]{};
+};
+
+// what a key costs the memory budget : its slot, its key and its value
+inline int64_t footprint(const size_t klen, const size_t vlen) {
+    return static_cast<int64_t>(sizeof(TB_slot) + klen + vlen);
+}
+
+inline Blob* ool(const uint8_t n, const uint64_t w0) {
+    return n == OOL ? reinterpret_cast<Blob*>(w0) : nullptr;
+}
+
+// probe key ; never allocates
+inline Packed pack_view(const std::string_view src) {
+    Packed p;
+    if (src.size() > INLINE_MAX) {
+        p.n = OOL;
+        return p;
+    }
+    p.n = static_cast<uint8_t>(src.size());
+    std::memcpy(p.w, src.data(), src.size());
+    return p;
+}
+
+// payload to store ; long ones get a slab copy the slot will own
+inline Packed pack_owned(const std::string_view src) {
+    if (src.size() <= INLINE_MAX) return pack_view(src);
+    Packed p;
+    p.n = OOL;
+    p.w[0] = reinterpret_cast<uint64_t>(blob_new(src));
+    return p;
+}
+
+inline Packed load_packed(const atomic<uint8_t>& n, const atomic<uint64_t>* w) {
+    Packed p;
+    p.n = n.load(relaxed);
+    for (int i = 0; i < INLINE_WORDS; i++) p.w[i] = w[i].load(relaxed);
+    return p;
+}
+
+inline void store_packed(atomic<uint8_t>& n, atomic<uint64_t>* w, const Packed& p) {
+    n.store(p.n, relaxed);
+    for (int i = 0; i < INLINE_WORDS; i++) w[i].store(p.w[i], relaxed);
+}
+
+// caller owns or protects a long one
+inline std::string_view view(const Packed& p) {
+    if (p.n == OOL) return ool(p.n, p.w[0])->view();
+    return {reinterpret_cast<const char*>(p.w), p.n};
+}
+
+inline void unpack(const Packed& p, string& out) {
+    if (p.n == OOL) out = ool(p.n, p.w[0])->view();
+    else out.assign(reinterpret_cast<const char*>(p.w), p.n);
+}
+
+// slot owner only ; leaves I/U/X/P and wakes any parked set()
+inline void release_slot(TB_slot& slot, const char to) {
+    slot.s.store(to, seq_cst);
+    if (slot.parked.load(seq_cst) != 0) slot.s.notify_all();
+}
+
+// sleep until s moves off 'from'
+inline void park(TB_slot& slot, const char from) {
+    slot.parked.fetch_add(1, seq_cst);
+    if (slot.s.load(seq_cst) == from) slot.s.wait(from, acquire);
+    slot.parked.fetch_sub(1, relaxed);
+}
+
+// slot owner only (I/U/X/P) ; readers retry while ver is odd or moved
+inline void begin_write(TB_slot& slot) {
+    slot.ver.store(slot.ver.load(relaxed) + 1, relaxed);
+    std::atomic_thread_fence(release);
+}
+
+inline void end_write(TB_slot& slot) {
+    slot.ver.store(slot.ver.load(relaxed) + 1, release);
+}
+
+// slot owner only ; the key can't change under us
+inline bool owned_key_is(const TB_slot& slot, const Packed& pk, const std::string_view k) {
+    const Packed sk = load_packed(slot.kn, slot.kw);
+    if (sk.n != pk.n) return false;
+    if (sk.n == OOL) return ool(sk.n, sk.w[0])->view() == k;
+    return std::memcmp(sk.w, pk.w, sizeof(pk.w)) == 0;
+}
+
+// 1 match | 0 other key | -1 slot rewritten mid read
+// ver is the version the answer holds for ; a long key stays under HP slot K
+inline int match_key(const TB_slot& slot, const Packed& pk, const std::string_view k, uint32_t& ver) {
+    ver = slot.ver.load(acquire);
+    if (ver & 1) return -1;
+
+    const Packed sk = load_packed(slot.kn, slot.kw);
+    bool eq = false;
+
+    if (sk.n == pk.n && sk.n != OOL) {
+        eq = std::memcmp(sk.w, pk.w, sizeof(pk.w)) == 0;
+    }
+    else if (sk.n == pk.n) {
+        Blob* ptr_k = ool(sk.n, sk.w[0]);
+        hazard(K, ptr_k);
+        if (slot.ver.load(acquire) != ver) return -1;
+        eq = ptr_k->view() == k;
+    }
+
+    std::atomic_thread_fence(acquire);
+    if (slot.ver.load(relaxed) != ver) return -1;
+    return eq ? 1 : 0;
+}
+
+// key, value and deadline as of ver ; false if the slot was mid write or moved on
+// long ones stay under HP slots K and V
+inline bool read_kv(const TB_slot& slot, string& k, string& v, uint32_t& exp, uint32_t& ver) {
+    ver = slot.ver.load(acquire);
+    if (ver & 1) return false;
+
+    const Packed sk = load_packed(slot.kn, slot.kw);
+    const Packed sv = load_packed(slot.vn, slot.vw);
+    exp = slot.exp.load(relaxed);
+    Blob* ptr_k = ool(sk.n, sk.w[0]);
+    Blob* ptr_v = ool(sv.n, sv.w[0]);
+    if (ptr_k != nullptr) hazard(K, ptr_k);
+    if (ptr_v != nullptr) hazard(V, ptr_v);
+    if ((ptr_k != nullptr || ptr_v != nullptr) && slot.ver.load(acquire) != ver) return false;
+
+    unpack(sk, k);
+    unpack(sv, v);
+    std::atomic_thread_fence(acquire);
+    return slot.ver.load(relaxed) == ver;
+}
+
+// copies the value out as of ver ; false if the slot moved on
+// a long value stays under HP slot V
+inline bool read_val(const TB_slot& slot, const uint32_t ver, string& out) {
+    const Packed sv = load_packed(slot.vn, slot.vw);
+
+    if (sv.n == OOL) {
+        Blob* ptr_v = ool(sv.n, sv.w[0]);
+        hazard(V, ptr_v);
+        if (slot.ver.load(acquire) != ver) return false;
+        out = ptr_v->view();
+        return true;
+    }
+
+    std::atomic_thread_fence(acquire);
+    if (slot.ver.load(relaxed) != ver) return false;
+    unpack(sv, out);
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "types.h"
+#include <string>
+
+// snapshot file ; everything little endian, read in place from a read-only mapping
+//
+//   SnapHeader | block | block | ... | uint64 offset of each block
+//   block  : SnapBlock, then n records
+//   record : uint32 klen | uint32 vlen | uint32 exp | key | value
+//
+// blocks are what the loader's threads split the file by
+struct SnapHeader {
+    char magic[8];
+    uint64_t keys;          // records ; a key caught mid resize may be in two of them
+    uint64_t blocks;
+    uint64_t index;         // file offset of the block offsets
+};
+
+struct SnapBlock {
+    uint32_t n;
+    uint32_t bytes;         // records only
+};
+
+// where a walk sends what it reads
+struct KvSink {
+    virtual void add(const string& k, const string& v, uint32_t exp) = 0;
+    virtual ~KvSink() = default;
+};
+
+// every live key under roots, each read whole at one version, alongside live traffic
+// the caller needs an hp index ; under EBR this holds an epoch per root for the whole walk
+void walk_roots(const vector<atomic<Table*>*>& roots, KvSink& sink);
+
+// routes a key hash to one of the roots a load fills
+using SnapRoute = int (*)(uint64_t h);
+
+// walks every table under roots alongside live traffic and writes path (via path.tmp)
+// each key is read whole at one version ; writes racing the walk may or may not make it
+// returns the records written, throws on i/o errors
+size_t snapshot_save(const vector<atomic<Table*>*>& roots, const string& path);
+
+// snapshot_save on a thread of its own ; false if one is already running
+bool snapshot_begin(const vector<atomic<Table*>*>& roots, const string& path);
+
+// maps path and fills roots[route(h)] with threads workers, presized, no resizes ; keys that
+// expired since the save come back as misses, for the expiry thread to delete
+// roots must not be serving yet. returns the keys loaded, throws on a bad file
+size_t snapshot_load(const string& path, const vector<atomic<Table*>*>& roots, SnapRoute route, int threads);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include "types.h"
+
+// bounded single producer / single consumer ring ; N a power of two
+// each side keeps a stale copy of the other's index and only reloads it when the ring looks full/empty
+template<typename T, size_t N>
+struct Spsc {
+    static_assert((N & (N - 1)) == 0);
+
+    alignas(64) atomic<size_t> head{0};     // next to pop ; consumer's
+    size_t tail_seen{0};
+    alignas(64) atomic<size_t> tail{0};     // next to push ; producer's
+    size_t head_seen{0};
+    alignas(64) T buf[N];
+
+    // producer only
+    bool push(const T& v) {
+        const size_t t = tail.load(relaxed);
+        if (t - head_seen == N) {
+            head_seen = head.load(acquire);
+            if (t - head_seen == N) return false;
+        }
+        buf[t & (N - 1)] = v;
+        tail.store(t + 1, release);
+        return true;
+    }
+
+    // consumer only
+    bool pop(T& v) {
+        const size_t h = head.load(relaxed);
+        if (h == tail_seen) {
+            tail_seen = tail.load(acquire);
+            if (h == tail_seen) return false;
+        }
+        v = buf[h & (N - 1)];
+        head.store(h + 1, release);
+        return true;
+    }
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "types.h"
+#include "clock.h"
+
+// event tracer for the slot state machine, built in and off until trace_enable(true)
+// every transition (and every wait on a busy slot) becomes a fixed-size event : what, which
+// slot, when, how long, how many spins. each thread writes its own ring in trace_rings and
+// overwrites its oldest event, so nothing is shared and nothing locks ; off, a traced spot
+// costs one relaxed load. set() and del() only feed it in a ZOOM_INSTRUMENT build, see instr.h
+//
+// readers copy rings while they're written : an event's seq goes odd, then its words, then
+// even again, and a copy that saw seq move is dropped, seqlock style
+//
+// trace_json() is Chrome trace event JSON, for chrome://tracing or ui.perfetto.dev : a track
+// per thread, one complete event per transition or wait, args slot and spins
+
+constexpr uint8_t TRACE_SPIN = TRANSITION_TYPES;    // a wait on a busy slot ; the kinds below it are TransitionTypes
+
+void trace_event(uint8_t kind, size_t slot, Ticks start, Ticks end, int spins);
+
+// owner thread only
+inline void trace(const uint8_t kind, const size_t slot, const Ticks start, const Ticks end, const int spins) {
+    if (trace_on.load(relaxed)) trace_event(kind, slot, start, end, spins);
+}
+
+// on drops whatever was traced before it from later dumps ; off keeps it
+void trace_enable(bool on);
+
+// events since the last trace_enable(true), as they stand ; safe while tracing runs
+string trace_json();
+
+// trace_json() into path ; returns the events in it
+size_t trace_dump(const string& path);
+
+// trace_dump on a thread of its own ; false if one is already running
+bool trace_dump_begin(const string& path);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "types.h"
+#include <string_view>
+
+// per-key expiry. a slot's exp is the unix second its key dies at ; get() compares it to
+// ttl_now and that's all, so an expired key is a miss from the next tick on
+//
+// set() with a deadline drops (key, root, deadline) into its thread's ttl_bufs entry. one
+// expiry thread moves those into a hierarchical timer wheel (WHEEL_LEVELS levels of
+// 2^WHEEL_BITS one-second buckets) and each second deletes what its bucket holds through
+// the usual F -> X -> D, only if the key still expires by then. nothing ever scans a table
+
+// unix second a key set now with ex seconds to live dies at ; never earlier than ex from now
+uint32_t ttl_deadline(uint32_t ex);
+
+// called by set() ; k is copied
+void ttl_track(std::string_view k, atomic<Table*>* root, uint32_t at);
+
+// starts ttl_now and the expiry thread ; until then nothing expires
+void ttl_start();
@@ -4,27 +4,48 @@
 #include <string>
 #include <vector>
 #include <chrono>
+#include <cstdint>
+#include "registry.h"
+#include "hist.h"
 
 using std::string;
 using std::vector;
 using std::atomic;
 namespace chrono = std::chrono;
-using TimePoint = chrono::high_resolution_clock::time_point;
-using HRClock = chrono::high_resolution_clock;
 
-constexpr int MAX_THREADS = 250;
-constexpr int MAX_KEYS = 100;
+constexpr size_t INIT_CAPACITY = 128;   // power of two
+constexpr int MAX_LOAD_PCT = 75;        // grow once used slots pass this
+constexpr int MIN_LOAD_PCT = 10;        // shrink once live keys drop below this
+constexpr size_t MIGRATE_CHUNK = 64;    // slots moved per op while resizing
+constexpr size_t BATCH_WINDOW = 16;     // keys hashed and prefetched together by mget/mset/mdel
+constexpr size_t EVICT_SCAN = 32;       // slots the clock hand passes per set() while over budget
 constexpr int RETIRED_THRESHOLD = 100;
-constexpr int COOLDOWN_THRES = 10'000;
+constexpr int SPIN_PAUSE_MAX = 1024;        // pause backoff cap ; park on the slot past it
+constexpr int INLINE_WORDS = 3;
+constexpr uint8_t INLINE_MAX = INLINE_WORDS * 8;   // longer keys/values go out of line
+constexpr uint8_t OOL = 0xFF;
+constexpr int SLAB_CLASSES = 16;           // see SLAB_SIZES in slab.h
+constexpr int AOF_WRITE_MS = 10;            // flusher round when nobody waits on a commit
+constexpr size_t AOF_REWRITE_MIN = 64 << 20;   // auto rewrite once the log passes this and twice its last rewrite
+constexpr uint32_t TTL_NEVER = UINT32_MAX;  // exp of a key without a deadline
+constexpr int TTL_TICK_MS = 100;            // expiry thread round ; ttl_now moves on at most this late
+constexpr int WHEEL_BITS = 6;               // buckets per timer wheel level, as a power of two
+constexpr int WHEEL_LEVELS = 4;             // 1 s .. 2^24 s ; later deadlines wait in an overflow list
+constexpr size_t TRACE_RING = 1 << 14;      // events each thread's tracer keeps ; power of two
+constexpr int TSC_CALIBRATE_MS = 10;        // one-off spin timing the TSC against steady_clock ; see clock.h
 
 constexpr auto acq_rel = std::memory_order_acq_rel;
 constexpr auto release = std::memory_order_release;
 constexpr auto acquire = std::memory_order_acquire;
 constexpr auto relaxed = std::memory_order_relaxed;
+constexpr auto seq_cst = std::memory_order_seq_cst;
+
+struct Blob;
 
 enum HP_Index {
     K = 0,
-    V = 1
+    V = 1,
+    T = 2
 };
 
 enum TransitionType {
@@ -34,68 +55,122 @@ enum TransitionType {
     FUF_ABORT_TRANS,
     FUF_ABORT_DELETE_TRANS,
     FXD_TRANS,
-    FXD_ABORT_TRANS
+    FXD_ABORT_TRANS,
+    TRANSITION_TYPES
 };
 
+// one record per set() that had to spin ; the histograms' counts are the requests
 struct alignas(64) SpinMetrics {
-    vector<int> spins_per_req;
-    vector<int> cooldowns_per_req;
-    vector<double> spin_time_ms_per_req;
-    uint64_t reqs_that_spun{0};
-    uint64_t successful_spins{0};
-    uint64_t aborted_spins{0};
-
-    SpinMetrics() {
-        spins_per_req.reserve(100000);
-        cooldowns_per_req.reserve(100000);
-        spin_time_ms_per_req.reserve(100000);
-    }
+    Hist spins;
+    Hist parks;
+    Hist spin_ns;
+    atomic<uint64_t> successful_spins{0};
+    atomic<uint64_t> aborted_spins{0};
+    atomic<uint64_t> parked_reqs{0};    // parked at least once
+    atomic<uint64_t> parked_spins{0};   // spins of those
 };
 
 struct alignas(64) HP_Slot {
-    atomic<void*> slot[2]{ nullptr, nullptr };
+    atomic<void*> slot[3]{ nullptr, nullptr, nullptr };
     atomic<bool> in_use{ false };
 };
 
+// s : E empty | I inserting | F full | U updating | X deleting | D deleted
+//     P pinned while being copied to the next table | M moved to the next table
+// kn/vn : length of an inline key/value, or OOL when kw[0]/vw[0] hold a Blob*
+// ver   : bumped around every k/v rewrite ; odd while one is in progress
+// parked : set()s sleeping on s ; whoever moves s out of an owned state wakes them
+// exp   : unix second the key expires at, or TTL_NEVER ; written under ver along with k/v
+// ref   : set by get(), cleared by the eviction hand as it passes (CLOCK)
 struct alignas(64) TB_slot {
-    atomic<string*> k{nullptr};
-    atomic<string*> v{nullptr};
     atomic<char> s{'E'};
+    atomic<uint8_t> kn{0};
+    atomic<uint8_t> vn{0};
+    atomic<uint8_t> ref{0};
+    atomic<uint32_t> ver{0};
+    atomic<uint64_t> kw[INLINE_WORDS]{};
+    atomic<uint64_t> vw[INLINE_WORDS]{};
+    atomic<uint16_t> parked{0};
+    atomic<uint32_t> exp{TTL_NEVER};
+};
+static_assert(sizeof(TB_slot) == 64);
+
+struct Table {
+    const size_t cap;
+    vector<TB_slot> slots;
+    vector<atomic<uint8_t>> ctrl;           // one tag byte per slot ; see group.h
+    atomic<Table*> next{nullptr};           // resize target ; set once
+    atomic<Table*>* const root;             // the pointer this table and its successors hang off
+
+    alignas(64) atomic<size_t> used{0};     // slots claimed out of 'E'
+    alignas(64) atomic<size_t> live{0};     // slots holding a key
+    alignas(64) atomic<size_t> claimed{0};  // next slot to hand out for migration
+    alignas(64) atomic<size_t> migrated{0}; // slots done migrating
+    alignas(64) atomic<size_t> hand{0};     // next slot the eviction clock looks at
+
+    Table(const size_t capacity, atomic<Table*>* root) : cap(capacity), slots(capacity), ctrl(capacity), root(root) {}
+    ~Table();
 };
 
+// ns per transition, by TransitionType ; the histograms' counts are the transition counts
 struct alignas(64) TransitionMetrics {
-    vector<double> EIF_times;   // insert into empty
-    vector<double> DIF_times;   // insert into deleted
-    vector<double> FUF_times;   // update
-    vector<double> FXD_times;   // delete
-    vector<double> FUF_abort_times; // abort (key swapped)
-    vector<double> FUF_abort_delete_times; // abort (key deleted)
-    vector<double> FXD_abort_times; // abort (job already done)
-
-    // Counts
-    uint64_t EIF_count{0};
-    uint64_t DIF_count{0};
-    uint64_t FUF_count{0};
-    uint64_t FUF_abort_count{0}; // key swapped during set
-    uint64_t FUF_abort_delete_count{0}; // key deleted during set
-    uint64_t FXD_count{0};
-    uint64_t FXD_abort_count{0}; // key deleted during del
-
-    TransitionMetrics() {
-        EIF_times.reserve(10000);
-        DIF_times.reserve(10000);
-        FUF_times.reserve(100000);
-        FXD_times.reserve(10000);
-        FUF_abort_times.reserve(1000);
-        FUF_abort_delete_times.reserve(1000);
-        FXD_abort_times.reserve(1000);
-    }
+    Hist times[TRANSITION_TYPES];
+};
+
+// bytes handed out per size class, last one is large blocks
+// a block freed by another thread goes negative here ; only the sum means anything
+struct alignas(64) SlabStats {
+    atomic<int64_t> bytes[SLAB_CLASSES + 1]{};
+};
+
+// writes one thread logged that the flusher hasn't taken yet ; see aof.h
+struct alignas(64) AofBuf {
+    std::atomic_flag lock;
+    string data;
+};
+
+// keys one thread set with a deadline that the expiry thread hasn't taken yet ; see ttl.h
+struct TtlEntry {
+    string key;
+    atomic<Table*>* root;
+    uint32_t at;
+};
+
+struct alignas(64) TtlBuf {
+    std::atomic_flag lock;
+    vector<TtlEntry> pending;
+};
+
+// one traced event ; seq is odd while its thread rewrites it, see trace.h
+struct TraceEvent {
+    atomic<uint64_t> seq{0};
+    atomic<uint64_t> ts{0};             // start, in ticks() ; see clock.h
+    atomic<uint64_t> dur_slot{0};       // ns taken << 32 | slot index
+    atomic<uint64_t> kind_spins{0};     // kind << 32 | spins
+};
+
+// a thread's last TRACE_RING events ; ev comes the first time it traces and stays
+struct alignas(64) TraceRing {
+    atomic<TraceEvent*> ev{nullptr};
+    atomic<uint64_t> head{0};           // events it ever wrote
 };
 
-extern vector<TransitionMetrics> transition_metrics;
-extern vector<HP_Slot> hp;
-extern vector<TB_slot> tb;
-extern vector<SpinMetrics> spin_metrics;
+// indexed by my_hp_index ; metrics records follow the hp registry
+extern Registry<TransitionMetrics> transition_metrics;
+extern Registry<SlabStats> slab_stats;
+extern Registry<AofBuf> aof_bufs;
+extern Registry<TtlBuf> ttl_bufs;
+extern Registry<TraceRing> trace_rings;
+extern Registry<HP_Slot> hp;
+extern atomic<int> active_hp_threads;
+extern atomic<Table*> tb;
+extern thread_local atomic<Table*>* my_tb;   // where this thread's ops start ; tb unless it serves a shard
+extern Registry<SpinMetrics> spin_metrics;
+alignas(64) extern atomic<uint32_t> ttl_now;     // unix seconds as of the expiry thread's last tick
+extern size_t mem_budget;                        // bytes of keys, values and their slots ; 0 is no limit
+alignas(64) extern atomic<int64_t> kv_bytes;     // the same, as stored right now ; see footprint()
+alignas(64) extern atomic<bool> trace_on;        // see trace.h
 
-extern thread_local vector<string*> retired_list;
+extern thread_local vector<Blob*> retired_list;
+extern thread_local vector<Table*> retired_tables;
 extern thread_local int my_hp_index;
\ No newline at end of file
@@ -1,63 +1,31 @@
 #include "include/metrics.h"
+#include "include/reclaim.h"
+#include "include/trace.h"
 #include <algorithm>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
+#include <cmath>
+#include <cstring>
 
 using std::ostringstream;
 using std::string;
 
-void log_transition(TransitionType type, TimePoint start, TimePoint end) {
-    double duration_ms = chrono::duration<double>(end - start).count() * 1000.0;
-    auto& tm = transition_metrics[my_hp_index];
-
-    switch(type) {
-        case EIF_TRANS:
-            tm.EIF_times.push_back(duration_ms);
-            tm.EIF_count++;
-            break;
-
-        case DIF_TRANS:
-            tm.DIF_times.push_back(duration_ms);
-            tm.DIF_count++;
-            break;
-
-        case FUF_TRANS:
-            tm.FUF_times.push_back(duration_ms);
-            tm.FUF_count++;
-            break;
-
-        case FUF_ABORT_TRANS:
-            tm.FUF_abort_times.push_back(duration_ms);
-            tm.FUF_abort_count++;
-            break;
-
-        case FUF_ABORT_DELETE_TRANS:
-            tm.FUF_abort_delete_times.push_back(duration_ms);
-            tm.FUF_abort_delete_count++;
-            break;
-
-        case FXD_TRANS:
-            tm.FXD_times.push_back(duration_ms);
-            tm.FXD_count++;
-            break;
-
-        case FXD_ABORT_TRANS:
-            tm.FXD_abort_times.push_back(duration_ms);
-            tm.FXD_abort_count++;
-            break;
-    }
+void log_transition(TransitionType type, Ticks start, Ticks end, size_t slot, int spins) {
+    const uint64_t ns = ticks_to_ns(end - start);
+    transition_metrics[my_hp_index].times[type].record(ns);
+    trace(type, slot, start, end, spins);
 }
 
-void log_spins(int spins, int cooldowns, double spin_time_ms, bool success) {
-    spin_metrics[my_hp_index].spins_per_req.push_back(spins);
-    spin_metrics[my_hp_index].cooldowns_per_req.push_back(cooldowns);
-    spin_metrics[my_hp_index].spin_time_ms_per_req.push_back(spin_time_ms);
-    spin_metrics[my_hp_index].reqs_that_spun++;
-    if (success) {
-        spin_metrics[my_hp_index].successful_spins++;
-    } else {
-        spin_metrics[my_hp_index].aborted_spins++;
+void log_spins(int spins, int parks, uint64_t spin_ns, bool success) {
+    auto& sm = spin_metrics[my_hp_index];
+    sm.spins.record(spins);
+    sm.parks.record(parks);
+    sm.spin_ns.record(spin_ns);
+    owner_add(success ? sm.successful_spins : sm.aborted_spins, 1);
+    if (parks > 0) {
+        owner_add(sm.parked_reqs, 1);
+        owner_add(sm.parked_spins, spins);
     }
 }
 
@@ -78,107 +46,56 @@ string format_number(double num) {
     return oss.str();
 }
 
+static double ms(const double ns) {
+    return ns / 1'000'000.0;
+}
+
+// percentiles come off histograms merged across threads ; see hist.h for their error
 string get_spin_metrics(int total_set_ops) {
-    vector<int> all_spins;
-    vector<int> all_cooldowns;
-    vector<double> all_spin_times;
-    uint64_t total_reqs_that_spun = 0;
+    Hist spins, parks, spin_ns;
     uint64_t total_successful = 0;
     uint64_t total_aborted = 0;
+    uint64_t parked_reqs = 0;
+    uint64_t parked_spins = 0;
 
     vector<double> per_thread_avg_spins;
-    vector<int> per_thread_max_cooldowns;
-
-    for (const auto& metrics : spin_metrics) {
-        all_spins.insert(all_spins.end(),
-                        metrics.spins_per_req.begin(),
-                        metrics.spins_per_req.end());
-        all_cooldowns.insert(all_cooldowns.end(),
-                            metrics.cooldowns_per_req.begin(),
-                            metrics.cooldowns_per_req.end());
-        all_spin_times.insert(all_spin_times.end(),
-                             metrics.spin_time_ms_per_req.begin(),
-                             metrics.spin_time_ms_per_req.end());
-        total_reqs_that_spun += metrics.reqs_that_spun;
-        total_successful += metrics.successful_spins;
-        total_aborted += metrics.aborted_spins;
-
-        if (!metrics.spins_per_req.empty()) {
-            double thread_total = 0;
-            for (int s : metrics.spins_per_req) thread_total += s;
-            per_thread_avg_spins.push_back(thread_total / metrics.spins_per_req.size());
+    vector<uint64_t> per_thread_max_parks;
+
+    spin_metrics.for_each([&](const SpinMetrics& metrics) {
+        spins.merge(metrics.spins);
+        parks.merge(metrics.parks);
+        spin_ns.merge(metrics.spin_ns);
+        total_successful += metrics.successful_spins.load(relaxed);
+        total_aborted += metrics.aborted_spins.load(relaxed);
+        parked_reqs += metrics.parked_reqs.load(relaxed);
+        parked_spins += metrics.parked_spins.load(relaxed);
+
+        if (metrics.spins.count() > 0) {
+            per_thread_avg_spins.push_back(metrics.spins.mean());
+            per_thread_max_parks.push_back(metrics.parks.max());
         }
+    });
 
-        if (!metrics.cooldowns_per_req.empty()) {
-            int thread_max_cooldown = *std::max_element(metrics.cooldowns_per_req.begin(),
-                                                        metrics.cooldowns_per_req.end());
-            per_thread_max_cooldowns.push_back(thread_max_cooldown);
-        }
-    }
-
-    if (all_spins.empty()) {
+    const uint64_t total_reqs_that_spun = spins.count();
+    if (total_reqs_that_spun == 0) {
         return "    Spinning:     No requests spun\n";
     }
 
-    std::sort(all_spins.begin(), all_spins.end());
-    std::sort(all_cooldowns.begin(), all_cooldowns.end());
-    std::sort(all_spin_times.begin(), all_spin_times.end());
-
-    uint64_t total_spins = 0;
-    for (int s : all_spins) total_spins += s;
-
-    uint64_t total_cooldowns = 0;
-    for (int c : all_cooldowns) total_cooldowns += c;
-
-    double total_spin_time_ms = 0;
-    for (double t : all_spin_times) total_spin_time_ms += t;
-
-    double avg_spins = static_cast<double>(total_spins) / all_spins.size();
-    int max_spins = all_spins.back();
-    int min_spins = all_spins[0];
-    int p50_spins = all_spins[all_spins.size() * 50 / 100];
-    int p95_spins = all_spins[all_spins.size() * 95 / 100];
-    int p99_spins = all_spins[all_spins.size() * 99 / 100];
-    int p999_spins = all_spins[all_spins.size() * 999 / 1000];
-
-    double avg_spin_time = total_spin_time_ms / all_spin_times.size();
-    double p50_spin_time = all_spin_times[all_spin_times.size() * 50 / 100];
-    double p95_spin_time = all_spin_times[all_spin_times.size() * 95 / 100];
-    double p99_spin_time = all_spin_times[all_spin_times.size() * 99 / 100];
-    double p999_spin_time = all_spin_times[all_spin_times.size() * 999 / 1000];
-    double max_spin_time = all_spin_times.back();
-
     double success_rate = (static_cast<double>(total_successful) / total_reqs_that_spun) * 100;
     double abort_rate = (static_cast<double>(total_aborted) / total_reqs_that_spun) * 100;
     double set_spin_rate = (static_cast<double>(total_reqs_that_spun) / total_set_ops) * 100;
 
-    int reqs_with_cooldown = 0;
-    for (int c : all_cooldowns) {
-        if (c > 0) reqs_with_cooldown++;
-    }
-
-    double avg_spins_with_cooldown = 0;
-    double avg_spins_without_cooldown = 0;
-    int count_with = 0, count_without = 0;
-    for (size_t i = 0; i < all_spins.size(); i++) {
-        if (all_cooldowns[i] > 0) {
-            avg_spins_with_cooldown += all_spins[i];
-            count_with++;
-        } else {
-            avg_spins_without_cooldown += all_spins[i];
-            count_without++;
-        }
-    }
-    if (count_with > 0) avg_spins_with_cooldown /= count_with;
-    if (count_without > 0) avg_spins_without_cooldown /= count_without;
+    const uint64_t spun_only = total_reqs_that_spun - parked_reqs;
+    const double avg_spins_with_park = parked_reqs > 0 ? static_cast<double>(parked_spins) / parked_reqs : 0;
+    const double avg_spins_without_park = spun_only > 0 ? static_cast<double>(spins.total() - parked_spins) / spun_only : 0;
 
     std::sort(per_thread_avg_spins.begin(), per_thread_avg_spins.end());
     double min_thread_avg = per_thread_avg_spins.empty() ? 0 : per_thread_avg_spins[0];
     double max_thread_avg = per_thread_avg_spins.empty() ? 0 : per_thread_avg_spins.back();
 
-    std::sort(per_thread_max_cooldowns.begin(), per_thread_max_cooldowns.end());
-    int min_thread_max_cooldown = per_thread_max_cooldowns.empty() ? 0 : per_thread_max_cooldowns[0];
-    int max_thread_max_cooldown = per_thread_max_cooldowns.empty() ? 0 : per_thread_max_cooldowns.back();
+    std::sort(per_thread_max_parks.begin(), per_thread_max_parks.end());
+    uint64_t min_thread_max_park = per_thread_max_parks.empty() ? 0 : per_thread_max_parks[0];
+    uint64_t max_thread_max_park = per_thread_max_parks.empty() ? 0 : per_thread_max_parks.back();
 
     ostringstream oss;
     oss << std::fixed;
@@ -189,35 +106,36 @@ string get_spin_metrics(int total_set_ops) {
         << " | success=" << std::setprecision(1) << success_rate
         << "% | abort=" << abort_rate << "%\n";
 
-    oss << "    Spins:   min=" << min_spins
-        << " | avg=" << format_number(avg_spins)
-        << " | p50=" << format_number(p50_spins)
-        << " | p95=" << format_number(p95_spins)
-        << " | p99=" << format_number(p99_spins)
-        << " | p999=" << format_number(p999_spins)
-        << " | max=" << format_number(max_spins) << "\n";
-
-    oss << "    Time:    avg=" << std::setprecision(3) << avg_spin_time << "ms"
-        << " | p50=" << p50_spin_time << "ms"
-        << " | p95=" << p95_spin_time << "ms"
-        << " | p99=" << p99_spin_time << "ms"
-        << " | p999=" << p999_spin_time << "ms"
-        << " | max=" << max_spin_time << "ms"
-        << " | total=" << std::setprecision(1) << total_spin_time_ms << "ms\n";
-
-    oss << "    Cooldown: reqs=" << format_number(reqs_with_cooldown)
-        << " (" << std::setprecision(1) << (static_cast<double>(reqs_with_cooldown) / all_cooldowns.size() * 100) << "%)"
-        << " | total=" << format_number(total_cooldowns)
-        << " | max=" << all_cooldowns.back() << "\n";
-
-    if (count_with > 0) {
-        oss << "    Avg spins (with cooldown):    "
-            << format_number(avg_spins_with_cooldown) << "\n";
+    oss << "    Spins:   min=" << spins.min()
+        << " | avg=" << format_number(spins.mean())
+        << " | p50=" << format_number(spins.percentile(50))
+        << " | p95=" << format_number(spins.percentile(95))
+        << " | p99=" << format_number(spins.percentile(99))
+        << " | p999=" << format_number(spins.percentile(99.9))
+        << " | max=" << format_number(spins.max()) << "\n";
+
+    oss << "    Time:    avg=" << std::setprecision(3) << ms(spin_ns.mean()) << "ms"
+        << " | p50=" << ms(spin_ns.percentile(50)) << "ms"
+        << " | p95=" << ms(spin_ns.percentile(95)) << "ms"
+        << " | p99=" << ms(spin_ns.percentile(99)) << "ms"
+        << " | p999=" << ms(spin_ns.percentile(99.9)) << "ms"
+        << " | max=" << ms(spin_ns.max()) << "ms"
+        << " | total=" << std::setprecision(1) << ms(spin_ns.total()) << "ms\n";
+
+    oss << "    Waits:   parked=" << format_number(parked_reqs)
+        << " (" << std::setprecision(1) << (static_cast<double>(parked_reqs) / total_reqs_that_spun * 100) << "%)"
+        << " | spun only=" << format_number(spun_only)
+        << " | parks total=" << format_number(parks.total())
+        << " | max=" << parks.max() << "\n";
+
+    if (parked_reqs > 0) {
+        oss << "    Avg spins (parked):    "
+            << format_number(avg_spins_with_park) << "\n";
     }
 
-    if (count_without > 0) {
-        oss << "    Avg spins (without cooldown): "
-            << format_number(avg_spins_without_cooldown) << "\n";
+    if (spun_only > 0) {
+        oss << "    Avg spins (spun only): "
+            << format_number(avg_spins_without_park) << "\n";
     }
 
     if (!per_thread_avg_spins.empty()) {
@@ -226,93 +144,68 @@ string get_spin_metrics(int total_set_ops) {
             << " | Δ=" << format_number(max_thread_avg - min_thread_avg) << "\n";
     }
 
-    if (!per_thread_max_cooldowns.empty()) {
-        oss << "    Per-thread max cooldowns: min=" << min_thread_max_cooldown
-            << " | max=" << max_thread_max_cooldown
-            << " | Δ=" << (max_thread_max_cooldown - min_thread_max_cooldown) << "\n";
+    if (!per_thread_max_parks.empty()) {
+        oss << "    Per-thread max parks: min=" << min_thread_max_park
+            << " | max=" << max_thread_max_park
+            << " | Δ=" << (max_thread_max_park - min_thread_max_park) << "\n";
     }
 
     return oss.str();
 }
 
 string get_transition_metrics() {
-    vector<double> all_EIF, all_DIF, all_FUF, all_FXD, all_FUF_abort, all_FUF_abort_delete, all_FXD_abort;
-    uint64_t total_EIF = 0, total_DIF = 0, total_FUF = 0, total_FXD = 0, total_FUF_abort = 0, total_FUF_abort_delete = 0, total_FXD_abort = 0;
-
-    for (const auto& tm : transition_metrics) {
-        all_EIF.insert(all_EIF.end(), tm.EIF_times.begin(), tm.EIF_times.end());
-        all_DIF.insert(all_DIF.end(), tm.DIF_times.begin(), tm.DIF_times.end());
-        all_FUF.insert(all_FUF.end(), tm.FUF_times.begin(), tm.FUF_times.end());
-        all_FXD.insert(all_FXD.end(), tm.FXD_times.begin(), tm.FXD_times.end());
-        all_FUF_abort.insert(all_FUF_abort.end(), tm.FUF_abort_times.begin(), tm.FUF_abort_times.end());
-        all_FUF_abort_delete.insert(all_FUF_abort_delete.end(), tm.FUF_abort_delete_times.begin(), tm.FUF_abort_delete_times.end());
-        all_FXD_abort.insert(all_FXD_abort.end(), tm.FXD_abort_times.begin(), tm.FXD_abort_times.end());
-
-        total_EIF += tm.EIF_count;
-        total_DIF += tm.DIF_count;
-        total_FUF += tm.FUF_count;
-        total_FXD += tm.FXD_count;
-        total_FUF_abort += tm.FUF_abort_count;
-        total_FUF_abort_delete += tm.FUF_abort_delete_count;
-        total_FXD_abort += tm.FXD_abort_count;
-    }
+    Hist all[TRANSITION_TYPES];
+    transition_metrics.for_each([&](const TransitionMetrics& tm) {
+        for (int i = 0; i < TRANSITION_TYPES; i++) all[i].merge(tm.times[i]);
+    });
 
     ostringstream oss;
     oss << std::fixed << std::setprecision(4);
 
-    auto format_transition = [&](const string& name,
-                                 const vector<double>& times,
-                                 uint64_t count) -> string {
-        if (times.empty()) {
+    auto format_transition = [&](const string& name, const Hist& times) -> string {
+        if (times.count() == 0) {
             return "    " + name + ": count=0\n";
         }
 
-        vector<double> sorted = times;
-        std::sort(sorted.begin(), sorted.end());
-
-        double min_t = sorted[0];
-        double max_t = sorted.back();
-        double total = 0;
-        for (double t : sorted) total += t;
-        double mean_t = total / sorted.size();
-
-        double p50 = sorted[sorted.size() * 50 / 100];
-        double p95 = sorted[sorted.size() * 95 / 100];
-        double p99 = sorted[sorted.size() * 99 / 100];
-        double p999 = sorted[sorted.size() * 999 / 1000];
-
         ostringstream line;
         line << std::fixed << std::setprecision(4);
         line << "    " << name << ": "
-             << "count=" << format_number(count) << " | "
-             << "min=" << min_t << "ms | "
-             << "mean=" << mean_t << "ms | "
-             << "p50=" << p50 << "ms | "
-             << "p95=" << p95 << "ms | "
-             << "p99=" << p99 << "ms | "
-             << "p999=" << p999 << "ms | "
-             << "max=" << max_t << "ms\n";
+             << "count=" << format_number(times.count()) << " | "
+             << "min=" << ms(times.min()) << "ms | "
+             << "mean=" << ms(times.mean()) << "ms | "
+             << "p50=" << ms(times.percentile(50)) << "ms | "
+             << "p95=" << ms(times.percentile(95)) << "ms | "
+             << "p99=" << ms(times.percentile(99)) << "ms | "
+             << "p999=" << ms(times.percentile(99.9)) << "ms | "
+             << "max=" << ms(times.max()) << "ms\n";
         return line.str();
     };
 
+    const uint64_t total_EIF = all[EIF_TRANS].count();
+    const uint64_t total_DIF = all[DIF_TRANS].count();
+    const uint64_t total_FUF = all[FUF_TRANS].count();
+    const uint64_t total_FXD = all[FXD_TRANS].count();
+    const uint64_t total_FUF_abort = all[FUF_ABORT_TRANS].count();
+    const uint64_t total_FUF_abort_delete = all[FUF_ABORT_DELETE_TRANS].count();
+    const uint64_t total_FXD_abort = all[FXD_ABORT_TRANS].count();
+
     oss << "\n    Transitions:\n";
-    oss << format_transition("E→I→F (insert empty)    ", all_EIF, total_EIF);
-    oss << format_transition("D→I→F (insert deleted)  ", all_DIF, total_DIF);
-    oss << format_transition("F→U→F (update)          ", all_FUF, total_FUF);
-    oss << format_transition("F→X→D (delete)          ", all_FXD, total_FXD);
+    oss << format_transition("E→I→F (insert empty)    ", all[EIF_TRANS]);
+    oss << format_transition("D→I→F (insert deleted)  ", all[DIF_TRANS]);
+    oss << format_transition("F→U→F (update)          ", all[FUF_TRANS]);
+    oss << format_transition("F→X→D (delete)          ", all[FXD_TRANS]);
 
     if (total_FUF_abort > 0) {
-        oss << format_transition("F→U→F (abort swap)     ", all_FUF_abort, total_FUF_abort);
+        oss << format_transition("F→U→F (abort swap)     ", all[FUF_ABORT_TRANS]);
     }
 
     if (total_FUF_abort_delete > 0) {
-        oss << format_transition("F→U→D (abort delete)   ", all_FUF_abort_delete, total_FUF_abort_delete);
+        oss << format_transition("F→U→D (abort delete)   ", all[FUF_ABORT_DELETE_TRANS]);
     }
 
     if (total_FXD_abort > 0) {
-        oss << format_transition("F→X→D (abort)          ", all_FXD_abort, total_FXD_abort);
+        oss << format_transition("F→X→D (abort)          ", all[FXD_ABORT_TRANS]);
     }
-
     uint64_t total_transitions = total_EIF + total_DIF + total_FUF + total_FXD + total_FUF_abort + total_FUF_abort_delete + total_FXD_abort;
     if (total_transitions > 0) {
         oss << std::setprecision(1);
@@ -338,4 +231,92 @@ string get_transition_metrics() {
     }
 
     return oss.str();
-}
\ No newline at end of file
+}
+static const char* const TRANSITION_NAMES[TRANSITION_TYPES] = {
+    "eif", "dif", "fuf", "fuf_abort", "fuf_abort_delete", "fxd", "fxd_abort",
+};
+
+void add_summary(vector<Stat>& out, const char* family, const char* help, const string& labels, const Hist& h, const double scale) {
+    const string pre = labels.empty() ? "" : labels + ",";
+    for (const char* q : {"0.5", "0.9", "0.99", "0.999"}) {
+        out.push_back({family, "summary", help, "", pre + "quantile=\"" + q + "\"", h.percentile(std::stod(q) * 100) * scale});
+    }
+    out.push_back({family, "summary", help, "_sum", labels, h.total() * scale});
+    out.push_back({family, "summary", help, "_count", labels, static_cast<double>(h.count())});
+}
+
+void collect_op_stats(vector<Stat>& out) {
+    Hist spins, spin_ns;
+    uint64_t successful = 0, aborted = 0, parked = 0, parks = 0;
+    spin_metrics.for_each([&](const SpinMetrics& m) {
+        spins.merge(m.spins);
+        spin_ns.merge(m.spin_ns);
+        successful += m.successful_spins.load(relaxed);
+        aborted += m.aborted_spins.load(relaxed);
+        parked += m.parked_reqs.load(relaxed);
+        parks += m.parks.total();
+    });
+    out.push_back({"zoom_spin_requests_total", "counter", "Writes that found their slot busy and spun.", "", "", static_cast<double>(spins.count())});
+    out.push_back({"zoom_spin_aborts_total", "counter", "Spinning writes that gave up.", "", "", static_cast<double>(aborted)});
+    out.push_back({"zoom_spin_successes_total", "counter", "Spinning writes that got their slot.", "", "", static_cast<double>(successful)});
+    out.push_back({"zoom_spins_total", "counter", "Backoff rounds spent spinning.", "", "", static_cast<double>(spins.total())});
+    out.push_back({"zoom_parked_requests_total", "counter", "Spinning writes that parked on the slot.", "", "", static_cast<double>(parked)});
+    out.push_back({"zoom_parks_total", "counter", "Times a write parked.", "", "", static_cast<double>(parks)});
+    add_summary(out, "zoom_spin_seconds", "Time a write spent spinning on a busy slot.", "", spin_ns, 1e-9);
+
+    Hist times[TRANSITION_TYPES];
+    transition_metrics.for_each([&](const TransitionMetrics& m) {
+        for (int i = 0; i < TRANSITION_TYPES; i++) times[i].merge(m.times[i]);
+    });
+    for (int i = 0; i < TRANSITION_TYPES; i++) {
+        add_summary(out, "zoom_transition_seconds", "Slot state transitions by kind, and how long they took.",
+                    string("kind=\"") + TRANSITION_NAMES[i] + "\"", times[i], 1e-9);
+    }
+}
+
+void collect_table_stats(const vector<atomic<Table*>*>& roots, vector<Stat>& out) {
+    get_my_hp_index();
+    size_t cap = 0, live = 0, used = 0, resizing = 0;
+    for (atomic<Table*>* root : roots) {
+        const OpGuard g;
+        const Table* t = protect(*root, T);
+        cap += t->cap;
+        live += t->live.load(relaxed);
+        used += t->used.load(relaxed);
+        if (t->next.load(relaxed) != nullptr) resizing++;
+    }
+    // live and used are read apart ; a delete between them can't make tombstones negative
+    const size_t tombstones = used > live ? used - live : 0;
+
+    out.push_back({"zoom_table_slots", "gauge", "Slots in the current tables.", "", "", static_cast<double>(cap)});
+    out.push_back({"zoom_table_keys", "gauge", "Slots holding a key.", "", "", static_cast<double>(live)});
+    out.push_back({"zoom_table_tombstones", "gauge", "Slots claimed but not holding a key, mostly deleted ones.", "", "", static_cast<double>(tombstones)});
+    out.push_back({"zoom_table_load_ratio", "gauge", "Claimed slots over slots.", "", "", cap == 0 ? 0 : static_cast<double>(used) / cap});
+    out.push_back({"zoom_tables_resizing", "gauge", "Tables with a resize in flight.", "", "", static_cast<double>(resizing)});
+    out.push_back({"zoom_kv_bytes", "gauge", "Bytes of keys, values and their slots.", "", "", static_cast<double>(kv_bytes.load(relaxed))});
+    out.push_back({"zoom_mem_budget_bytes", "gauge", "Eviction budget, 0 for none.", "", "", static_cast<double>(mem_budget)});
+}
+
+// integers as integers ; Prometheus reads either
+static void put_value(ostringstream& oss, const double v) {
+    if (v == std::floor(v) && std::fabs(v) < 9e15) oss << static_cast<int64_t>(v);
+    else oss << std::setprecision(9) << v;
+}
+
+string format_stats(const vector<Stat>& stats, const bool prometheus) {
+    ostringstream oss;
+    const char* family = nullptr;
+    for (const Stat& s : stats) {
+        if (prometheus && (family == nullptr || std::strcmp(family, s.family) != 0)) {
+            oss << "# HELP " << s.family << " " << s.help << "\n";
+            oss << "# TYPE " << s.family << " " << s.type << "\n";
+        }
+        family = s.family;
+        oss << s.family << s.suffix;
+        if (!s.labels.empty()) oss << "{" << s.labels << "}";
+        oss << " ";
+        put_value(oss, s.value);
+        oss << "\n";
+    }
+    return oss.str();
+}
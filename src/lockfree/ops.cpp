@@ -1,312 +1,569 @@
 #include "include/ops.h"
-#include "include/hp.h"
-#include "include/metrics.h"
+#include "include/reclaim.h"
+#include "include/instr.h"
+#include "include/resize.h"
+#include "include/slot.h"
+#include "include/group.h"
+#include "include/hash.h"
+#include "include/backoff.h"
+#include "include/ttl.h"
+#include "include/aof.h"
+#include <algorithm>
 #include <thread>
 
-size_t hash(const string& key) {
-    size_t h = 0;
-    for (const char c : key) h = h * 31 + c;
-    return h;
-}
-
-size_t hash2(const string& key) {
-    size_t h = 5381;
-    for (const char c : key) h = ((h << 5) + h) ^ c;
-    return h | 1;
-}
-
-void key_deleted_during_spin(bool did_spin, int spin_count, int cooldowns_hit, TimePoint spin_start) {
+template<typename Obs>
+static void key_deleted_during_spin(bool did_spin, int spin_count, int parks, typename Obs::Stamp spin_start, size_t slot) {
     // end spin
-    if (did_spin) {
-        auto spin_end = HRClock::now();
-        double spin_time_ms = chrono::duration<double>(spin_end - spin_start).count() * 1000.0;
-        log_spins(spin_count, cooldowns_hit, spin_time_ms, false);
-    }
+    if (did_spin) Obs::spun(spin_start, Obs::now(), spin_count, parks, false, slot);
     clear_hp(K);
 }
 
-string* get(const string& kB) {
-    const size_t y = hash(kB);
-    const size_t step = hash2(kB);
-    const size_t table_size = tb.size();
+static bool get_hashed(const std::string_view kB, const uint64_t h, string& out) {
+    const OpGuard g;
+    const size_t y = h;
+    const size_t step = step_of(h);
+    const uint8_t tag = tag_of(h);
+    const Packed pk = pack_view(kB);
+    Table* t = protect_table();
 
-    for (size_t j = 0; j < table_size; j++) {
-        const size_t i = (y + j * step) % table_size;
-        auto& CPSi = tb[i].s;
-        auto& CPKi = tb[i].k;
-        auto& CPVi = tb[i].v;
-        const char Si = CPSi.load(acquire);
+    do {
+        const size_t gmask = t->cap / GROUP_WIDTH - 1;
 
-        if (Si == 'E') return nullptr;
-        if (Si != 'F') continue;
+        for (size_t j = 0; j <= gmask; j++) {
+            const size_t base = ((y + j * step) & gmask) * GROUP_WIDTH;
+            const Group grp(&t->ctrl[base]);
 
-        // protect
-        string* ptr_ki = protect(CPKi, K);
-        if (ptr_ki == nullptr) {
-            clear_hp(K);
-            continue;
-        }
+            for (const size_t b : grp.match(tag)) {
+                auto& slot = t->slots[base + b];
+                const char Si = slot.s.load(acquire);
 
-        // wrong key
-        if (*ptr_ki != kB) {
-            clear_hp(K);
-            continue;
-        }
+                if (Si != 'F' && Si != 'U' && Si != 'P') continue;
 
-        // right key deleted
-        string* ptr_vi = protect(CPVi, V);
-        if (ptr_vi == nullptr) {
-            clear_hp_both();
-            continue;
-        }
+                while (true) {
+                    uint32_t ver;
+                    const int m = match_key(slot, pk, kB, ver);
 
-        // value not of key
-        if (ptr_ki != CPKi.load(acquire)) {
-            clear_hp_both();
-            continue;
-        }
-        clear_hp_both();
-        return ptr_vi;
-    }
-    return nullptr;
-}
+                    // slot rewritten mid read
+                    if (m < 0) continue;
 
-void set(const string& kA, const string& vA) {
-    restart:
-    const size_t y = hash(kA);
-    const size_t step = hash2(kA);
-    const size_t table_size = tb.size();
-    string* ptr_kA = nullptr;
-    string* ptr_vA = nullptr;
-
-    for (size_t j = 0; j < table_size; j++) {
-        const size_t i = (y + j * step) % table_size;
-        auto& CPKi = tb[i].k;
-        auto& CPVi = tb[i].v;
-        auto& CPSi = tb[i].s;
-        const char Si = CPSi.load(acquire);
-
-        // EIF
-        if (Si == 'E') {
-            char expected = 'E';
-            if (CPSi.compare_exchange_strong(expected, 'I', acq_rel, relaxed)) {
-                auto trans_start = HRClock::now();
-
-                ptr_kA = new string(kA);
-                ptr_vA = new string(vA);
-                CPKi.store(ptr_kA, relaxed);
-                CPVi.store(ptr_vA, relaxed);
-                CPSi.store('F', release);
-
-                auto trans_end = HRClock::now();
-                log_transition(EIF_TRANS, trans_start, trans_end);
-                return;
-            }
-            continue;
-        }
+                    // wrong key
+                    if (m == 0) break;
 
-        // DIF
-        if (Si == 'D') {
-            char expected = 'D';
-            if (CPSi.compare_exchange_strong(expected, 'I', acq_rel, relaxed)) {
-                auto trans_start = HRClock::now();
-
-                ptr_kA = new string(kA);
-                ptr_vA = new string(vA);
-                string* old_k = CPKi.exchange(ptr_kA, acq_rel);
-                string* old_v = CPVi.exchange(ptr_vA, acq_rel);
-                CPSi.store('F', release);
-                retire(old_k);
-                retire(old_v);
-
-                auto trans_end = HRClock::now();
-                log_transition(DIF_TRANS, trans_start, trans_end);
-                return;
+                    // value of key ; past its deadline it's a miss, whether or not it's been deleted yet
+                    const uint32_t exp = slot.exp.load(relaxed);
+                    if (read_val(slot, ver, out)) {
+                        if (exp <= ttl_now.load(relaxed)) return false;
+
+                        // referenced ; only stored when it changes, so a hot key's line stays shared
+                        if (slot.ref.load(relaxed) == 0) slot.ref.store(1, relaxed);
+                        return true;
+                    }
+                }
+                clear_hp_both();
             }
-            // lost cas ; other thread may have inserted our key
-            goto restart;
+
+            if (ends_chain(t, base, grp)) break;
         }
+    } while (advance(t));   // mid resize ; key may have moved on
 
-        if (Si != 'F') continue;
+    return false;
+}
 
-        // protect
-        string* ptr_ki = protect(CPKi, K);
-        if (ptr_ki == nullptr) {
+// slot mine of t is ours in I, tagged and keyed ; true if a racing insert of the same key
+// holds another slot on the chain. of two such inserts at least one sees the other
+static bool claimed_elsewhere(const Table* t, const size_t y, const size_t step, const uint8_t tag,
+                              const Packed& pk, const std::string_view k, const size_t mine) {
+    const size_t gmask = t->cap / GROUP_WIDTH - 1;
+
+    for (size_t j = 0; j <= gmask; j++) {
+        const size_t base = ((y + j * step) & gmask) * GROUP_WIDTH;
+        const Group grp(&t->ctrl[base]);
+
+        for (const size_t b : grp.match(tag)) {
+            if (base + b == mine) continue;
+            const auto& slot = t->slots[base + b];
+            const char Si = slot.s.load(acquire);
+            if (Si != 'I' && Si != 'F' && Si != 'U' && Si != 'P') continue;
+
+            uint32_t ver;
+            int m;
+            do m = match_key(slot, pk, k, ver); while (m < 0);
             clear_hp(K);
-            continue;
+            if (m == 1) return true;
         }
 
-        // bad key
-        if (*ptr_ki != kA) {
-            clear_hp(K);
-            continue;
-        }
+        if (ends_chain(t, base, grp)) break;
+    }
+    return false;
+}
 
-        // right key deleted
-        if (ptr_ki != CPKi.load(acquire)) {
-            clear_hp(K);
-            continue;
-        }
+// slot i of t is ours in I ; drops the key we put there and gives it back as it was (E or D)
+static void hand_back(Table* t, TB_slot& slot, const size_t i, const char to) {
+    const Packed pk = load_packed(slot.kn, slot.kw);
+    begin_write(slot);
+    slot.kn.store(0, relaxed);
+    end_write(slot);
+    t->ctrl[i].store(to == 'E' ? CTRL_EMPTY : CTRL_DELETED, relaxed);
+    release_slot(slot, to);
+    retire(ool(pk.n, pk.w[0]));
+}
 
-        int spin_count = 0;
-        int cooldowns_hit = 0;
-        bool did_spin = false;
-        TimePoint spin_start;
+template<typename Obs = OpInstr>
+static void set_hashed(const std::string_view kA, const uint64_t h, const std::string_view vA, const uint32_t exp) {
+    const OpGuard g;
+    const size_t y = h;
+    const size_t step = step_of(h);
+    const uint8_t tag = tag_of(h);
+    const Packed pk = pack_view(kA);
+    Backoff contended;
 
-        char updated_Si = CPSi.load(acquire);
+    restart:
+    Table* t = protect_table();
 
-        while (true) {
+    probe:
+    const size_t gmask = t->cap / GROUP_WIDTH - 1;
+    size_t free_i = t->cap;
 
-            // spin
-            if (updated_Si != 'F') {
-                spin_count++;
+    for (size_t j = 0; j <= gmask; j++) {
+        const size_t base = ((y + j * step) & gmask) * GROUP_WIDTH;
+        const Group grp(&t->ctrl[base]);
 
-                // start timer
-                if (!did_spin) {
-                    spin_start = HRClock::now();
-                    did_spin = true;
-                }
+        for (const size_t b : grp.match(tag)) {
+            auto& slot = t->slots[base + b];
+            auto& CPSi = slot.s;
+            const char Si = CPSi.load(acquire);
 
-                if (updated_Si == 'D' ) {
-                    key_deleted_during_spin(did_spin, spin_count, cooldowns_hit, spin_start);
-                    goto restart;  // Key deleted during spin - restart
-                }
+            // an I slot may be another insert of kA ; wait for it like an update
+            if (Si != 'F' && Si != 'U' && Si != 'P' && Si != 'I') continue;
 
-                // cooldown
-                if (spin_count % COOLDOWN_THRES == 0) {
-                    cooldowns_hit++;
-                    int sleep_ms;
-                    if             (cooldowns_hit <= 30)         sleep_ms = 10;
-                    else if     (cooldowns_hit <= 50)         sleep_ms = 20;
-                    else if     (cooldowns_hit <= 70)         sleep_ms = 30;
-                    else if     (cooldowns_hit <= 90)         sleep_ms = 50;
-                    else if     (cooldowns_hit <= 100)       sleep_ms = 60;
-                    else                                                    sleep_ms = 60;
-                    std::this_thread::sleep_for(chrono::milliseconds(sleep_ms));
-                }
+            // bad key
+            uint32_t ver;
+            int m;
+            do m = match_key(slot, pk, kA, ver); while (m < 0);
+            clear_hp(K);
+            if (m == 0) continue;
 
-                updated_Si = CPSi.load(acquire);
-                continue;
-            }
+            int spin_count = 0;
+            int parks = 0;
+            bool did_spin = false;
+            typename Obs::Stamp spin_start{};
+            Backoff backoff;
 
-            // key deleted/swapped ; probe
-            if (ptr_ki != CPKi.load(acquire)) {
-                key_deleted_during_spin(did_spin, spin_count, cooldowns_hit, spin_start);
-                goto restart;  // Key swapped during spin - restart
-            }
+            char updated_Si = CPSi.load(acquire);
 
-            // send cas - FUF start
-            if (CPSi.compare_exchange_strong(updated_Si, 'U', acq_rel, relaxed)) {
-                auto trans_start = HRClock::now();
+            while (true) {
 
-                // key deleted/swapped ; probe (ABORT CASE)
-                if (ptr_ki != CPKi.load(acquire)) {
-                    auto trans_end = HRClock::now();
-                    string* current_ki = CPKi.load(acquire);
+                // spin
+                if (updated_Si != 'F') {
+                    spin_count++;
 
-                    // key was deleted
-                    if (current_ki == nullptr) {
-                        CPSi.store('D', release);
-                        log_transition(FUF_ABORT_DELETE_TRANS, trans_start, trans_end);
+                    // start timer
+                    if (!did_spin) {
+                        spin_start = Obs::now();
+                        did_spin = true;
                     }
 
-                    // key was swapped
+                    if (updated_Si == 'D' || updated_Si == 'M' || updated_Si == 'E') {
+                        key_deleted_during_spin<Obs>(did_spin, spin_count, parks, spin_start, base + b);
+                        goto restart;  // Key deleted or moved during spin - restart
+                    }
+
+                    // pause, then sleep until the owner lets go
+                    if (!backoff.spent()) backoff();
                     else {
-                        CPSi.store('F', release);
-                        log_transition(FUF_ABORT_TRANS, trans_start, trans_end);
+                        park(slot, updated_Si);
+                        parks++;
                     }
 
-                    key_deleted_during_spin(did_spin, spin_count, cooldowns_hit, spin_start);
-                    goto restart;
+                    updated_Si = CPSi.load(acquire);
+                    continue;
                 }
 
-                // cas approved ~ FUF end
-                ptr_vA = new string(vA);
-                string *old_ptr_vi = CPVi.exchange(ptr_vA, acq_rel);
-                CPSi.store('F', release);
-                clear_hp(K);
-                retire(old_ptr_vi);
-
-                auto trans_end = HRClock::now();
-                log_transition(FUF_TRANS, trans_start, trans_end);
+                // send cas - FUF start
+                if (CPSi.compare_exchange_strong(updated_Si, 'U', acq_rel, relaxed)) {
+                    const auto trans_start = Obs::now();
+
+                    // key swapped since we matched ; probe (ABORT CASE)
+                    if (!owned_key_is(slot, pk, kA)) {
+                        const auto trans_end = Obs::now();
+                        release_slot(slot, 'F');
+                        Obs::transition(FUF_ABORT_TRANS, trans_start, trans_end, base + b, spin_count);
+                        key_deleted_during_spin<Obs>(did_spin, spin_count, parks, spin_start, base + b);
+                        goto restart;
+                    }
 
-                // end spin
-                if (did_spin) {
-                    auto spin_end = HRClock::now();
-                    double spin_time_ms = chrono::duration<double>(spin_end - spin_start).count() * 1000.0;
-                    log_spins(spin_count, cooldowns_hit, spin_time_ms, true);
+                    // cas approved ~ FUF end
+                    const Packed pv = pack_owned(vA);
+                    const Packed old = load_packed(slot.vn, slot.vw);
+                    const int64_t grew = static_cast<int64_t>(vA.size()) - static_cast<int64_t>(view(old).size());
+                    begin_write(slot);
+                    store_packed(slot.vn, slot.vw, pv);
+                    slot.exp.store(exp, relaxed);
+                    end_write(slot);
+                    const uint64_t ts = aof_stamp();
+                    release_slot(slot, 'F');
+                    aof_set(kA, vA, exp, ts);
+                    retire(ool(old.n, old.w[0]));
+                    kv_bytes.fetch_add(grew, relaxed);
+
+                    const auto trans_end = Obs::now();
+                    Obs::transition(FUF_TRANS, trans_start, trans_end, base + b, spin_count);
+
+                    // end spin
+                    if (did_spin) Obs::spun(spin_start, Obs::now(), spin_count, parks, true, base + b);
+                    return;
                 }
-                return;
+                // cas failed : spin!
             }
-            // cas failed : spin!
         }
-        // key deleted : probe!
+
+        // first free slot ; keep probing for kA
+        if (free_i == t->cap) free_i = first_free(t, base, grp);
+        if (ends_chain(t, base, grp)) break;
     }
 
-    throw std::runtime_error("Hash table full! Probed all " + std::to_string(table_size) + " slots.");
-}
+    // not in t ; new keys go to the newest table
+    if (advance(t)) goto probe;
 
-void del(const string& kx) {
-    const size_t y = hash(kx);
-    const size_t step = hash2(kx);
-    const size_t table_size = tb.size();
+    // probed every slot ; grow and retry
+    if (free_i == t->cap) {
+        start_resize(t);
+        goto restart;
+    }
 
-    for (size_t j = 0; j < table_size; j++) {
-        const size_t i = (y + j * step) % table_size;
-        auto& CPSi = tb[i].s;
-        auto& CPKi = tb[i].k;
-        auto& CPVi = tb[i].v;
-        char Si = CPSi.load(acquire);
+    auto& slot = t->slots[free_i];
+    auto& CPSi = slot.s;
+    const char Si = CPSi.load(acquire);
 
-        if (Si == 'E') return;
-        if (Si != 'F') continue;
+    // EIF
+    if (Si == 'E') {
 
-        string* ptr_ki = protect(CPKi, K);
+        // over the load limit ; grow, or wait for the current resize to land
+        if (t->used.load(relaxed) * 100 >= t->cap * MAX_LOAD_PCT) {
+            if (t->root->load(acquire) == t) start_resize(t);
+            else std::this_thread::yield();
+            goto restart;
+        }
 
-        // key deleted/swap
-        if (ptr_ki == nullptr) {
-            clear_hp(K);
-            continue;
+        char expected = 'E';
+        if (CPSi.compare_exchange_strong(expected, 'I', seq_cst, relaxed)) {
+
+            // resize started after we probed ; hand the slot back
+            if (t->next.load(seq_cst) != nullptr) {
+                release_slot(slot, 'E');
+                goto restart;
+            }
+
+            const auto trans_start = Obs::now();
+
+            // tag and key go up first so a racing insert of kA can find this slot
+            t->ctrl[free_i].store(tag, relaxed);
+            const Packed pkA = pack_owned(kA);
+            begin_write(slot);
+            store_packed(slot.kn, slot.kw, pkA);
+            end_write(slot);
+            std::atomic_thread_fence(seq_cst);
+
+            // it found a slot first, or we saw each other ; let it have the key
+            if (claimed_elsewhere(t, y, step, tag, pk, kA, free_i)) {
+                hand_back(t, slot, free_i, 'E');
+                contended();
+                goto restart;
+            }
+
+            const Packed pv = pack_owned(vA);
+            begin_write(slot);
+            store_packed(slot.vn, slot.vw, pv);
+            slot.exp.store(exp, relaxed);
+            slot.ref.store(0, relaxed);
+            end_write(slot);
+            const uint64_t ts = aof_stamp();
+            release_slot(slot, 'F');
+            aof_set(kA, vA, exp, ts);
+            kv_bytes.fetch_add(footprint(kA.size(), vA.size()), relaxed);
+
+            const auto trans_end = Obs::now();
+            Obs::transition(EIF_TRANS, trans_start, trans_end, free_i, 0);
+
+            t->live.fetch_add(1, relaxed);
+            t->used.fetch_add(1, relaxed);
+            return;
         }
+    }
 
-        // wrong key
-        if (*ptr_ki != kx) {
-            clear_hp(K);
-            continue;
+    // DIF
+    else if (Si == 'D') {
+        char expected = 'D';
+        if (CPSi.compare_exchange_strong(expected, 'I', seq_cst, relaxed)) {
+
+            // resize started after we probed ; hand the slot back
+            if (t->next.load(seq_cst) != nullptr) {
+                release_slot(slot, 'D');
+                goto restart;
+            }
+
+            const auto trans_start = Obs::now();
+
+            // tag and key go up first so a racing insert of kA can find this slot
+            t->ctrl[free_i].store(tag, relaxed);
+            const Packed pkA = pack_owned(kA);
+            begin_write(slot);
+            store_packed(slot.kn, slot.kw, pkA);
+            end_write(slot);
+            std::atomic_thread_fence(seq_cst);
+
+            // it found a slot first, or we saw each other ; let it have the key
+            if (claimed_elsewhere(t, y, step, tag, pk, kA, free_i)) {
+                hand_back(t, slot, free_i, 'D');
+                contended();
+                goto restart;
+            }
+
+            const Packed pv = pack_owned(vA);
+            begin_write(slot);
+            store_packed(slot.vn, slot.vw, pv);
+            slot.exp.store(exp, relaxed);
+            slot.ref.store(0, relaxed);
+            end_write(slot);
+            const uint64_t ts = aof_stamp();
+            release_slot(slot, 'F');
+            aof_set(kA, vA, exp, ts);
+            kv_bytes.fetch_add(footprint(kA.size(), vA.size()), relaxed);
+
+            const auto trans_end = Obs::now();
+            Obs::transition(DIF_TRANS, trans_start, trans_end, free_i, 0);
+
+            t->live.fetch_add(1, relaxed);
+            return;
         }
+    }
 
-        // key deleted/swap
-        if (ptr_ki != CPKi.load(acquire)) {
-            clear_hp(K);
+    // lost cas ; the winner may hold our key, and the probe now waits on it
+    goto restart;
+}
+
+// slot i of t is ours in X ; leaves a tombstone (X -> D)
+static void erase(Table* t, TB_slot& slot, const size_t i) {
+    const Packed pk = load_packed(slot.kn, slot.kw);
+    const Packed pv = load_packed(slot.vn, slot.vw);
+    const int64_t bytes = footprint(view(pk).size(), view(pv).size());
+    begin_write(slot);
+    slot.kn.store(0, relaxed);
+    slot.vn.store(0, relaxed);
+    end_write(slot);
+    release_slot(slot, 'D');
+    t->ctrl[i].store(CTRL_DELETED, relaxed);
+    retire(ool(pk.n, pk.w[0]));
+    retire(ool(pv.n, pv.w[0]));
+    kv_bytes.fetch_sub(bytes, relaxed);
+
+    // mostly tombstones ; shrink
+    const size_t live = t->live.fetch_sub(1, relaxed) - 1;
+    if (t->cap > INIT_CAPACITY && live * 100 < t->cap * MIN_LOAD_PCT) start_resize(t);
+}
+
+// only a key expiring by upto goes ; TTL_NEVER takes any
+template<typename Obs = OpInstr>
+static void del_hashed(const std::string_view kx, const uint64_t h, const uint32_t upto) {
+    const OpGuard g;
+    const size_t y = h;
+    const size_t step = step_of(h);
+    const uint8_t tag = tag_of(h);
+    const Packed pk = pack_view(kx);
+    Backoff backoff;
+
+    restart:
+    Table* t = protect_table();
+
+    do {
+        const size_t gmask = t->cap / GROUP_WIDTH - 1;
+
+        for (size_t j = 0; j <= gmask; j++) {
+            const size_t base = ((y + j * step) & gmask) * GROUP_WIDTH;
+            const Group grp(&t->ctrl[base]);
+
+            for (const size_t b : grp.match(tag)) {
+                auto& slot = t->slots[base + b];
+                auto& CPSi = slot.s;
+                const char Si = CPSi.load(acquire);
+
+                if (Si != 'F' && Si != 'U' && Si != 'P') continue;
+
+                // wrong key
+                uint32_t ver;
+                int m;
+                do m = match_key(slot, pk, kx, ver); while (m < 0);
+                clear_hp(K);
+                if (m == 0) continue;
+
+                char expected = 'F';
+                if (CPSi.compare_exchange_strong(expected, 'X', acq_rel, relaxed)) {
+
+                    const auto trans_start = Obs::now();
+
+                    // key swapped since we matched
+                    if (!owned_key_is(slot, pk, kx)) {
+                        release_slot(slot, 'F'); // FXD abort
+                        const auto trans_end = Obs::now();
+                        Obs::transition(FXD_ABORT_TRANS, trans_start, trans_end, base + b, 0);
+                        goto restart;
+                    }
+
+                    // set again with a later deadline, or none
+                    if (slot.exp.load(relaxed) > upto) {
+                        release_slot(slot, 'F');
+                        return;
+                    }
+
+                    const uint64_t ts = aof_stamp();
+                    erase(t, slot, base + b);
+                    aof_del(kx, ts);
+
+                    const auto trans_end = Obs::now();
+                    Obs::transition(FXD_TRANS, trans_start, trans_end, base + b, 0);
+                    return;
+                }
+
+                // key is being copied to the next table ; move the copy along, then follow it
+                if (expected == 'P' || expected == 'M') {
+                    if (Table* n = t->next.load(acquire)) help_migrate(t, n);
+                    backoff();
+                    goto restart;
+                }
+            }
+
+            if (ends_chain(t, base, grp)) break;
+        }
+    } while (advance(t));
+}
+
+// over budget : the clock hand passes up to EVICT_SCAN slots of the current table, giving a
+// key read since it last passed a second chance and evicting the rest through F -> X -> D
+// expired ones go first. the budget is soft, a set() that finds nothing to evict still lands
+// the hand only moves by what was looked at ; two setters may look at the same slots
+static void make_room() {
+    if (mem_budget == 0 || kv_bytes.load(relaxed) <= static_cast<int64_t>(mem_budget)) return;
+
+    const OpGuard g;
+    Table* t = protect_table();
+    if (t->next.load(acquire) != nullptr) return;   // mid resize ; its slots are on the move
+
+    const size_t start = t->hand.load(relaxed);
+    const uint32_t now = ttl_now.load(relaxed);
+    size_t n = 0;
+    for (; n < EVICT_SCAN && kv_bytes.load(relaxed) > static_cast<int64_t>(mem_budget); n++) {
+        const size_t i = (start + n) & (t->cap - 1);
+        auto& slot = t->slots[i];
+        if (slot.s.load(acquire) != 'F') continue;
+        if (slot.ref.load(relaxed) != 0 && slot.exp.load(relaxed) > now) {
+            slot.ref.store(0, relaxed);
             continue;
         }
 
         char expected = 'F';
-        if (CPSi.compare_exchange_strong(expected, 'X', acq_rel, relaxed)) {
+        if (!slot.s.compare_exchange_strong(expected, 'X', acq_rel, relaxed)) continue;
+        erase(t, slot, i);
+    }
+    t->hand.fetch_add(n, relaxed);
+}
 
-            auto trans_start = HRClock::now();
+bool get(const std::string_view kB, string& out) {
+    return get_hashed(kB, hash(kB), out);
+}
 
-            // key deleted / swapped
-            if (ptr_ki != CPKi.load(acquire)) {
-                CPSi.store('D', release); // FXD abort (job already done)
-                clear_hp(K);
-                auto trans_end = HRClock::now();
-                log_transition(FXD_ABORT_TRANS, trans_start, trans_end);
-                return;
-            }
+void set(const std::string_view kA, const std::string_view vA) {
+    set_hashed(kA, hash(kA), vA, TTL_NEVER);
+    make_room();
+}
 
-            string* ptr_k = CPKi.exchange(nullptr, acq_rel);
-            string* ptr_v = CPVi.exchange(nullptr, acq_rel);
-            CPSi.store('D', release);
-            clear_hp_both();
-            retire(ptr_k);
-            retire(ptr_v);
+void del(const std::string_view kx) {
+    del_hashed(kx, hash(kx), TTL_NEVER);
+}
 
-            auto trans_end = HRClock::now();
-            log_transition(FXD_TRANS, trans_start, trans_end);
-            return;
+void set(const std::string_view kA, const std::string_view vA, const uint32_t exp) {
+    set_hashed(kA, hash(kA), vA, exp);
+    if (exp != TTL_NEVER) ttl_track(kA, my_tb, exp);
+    make_room();
+}
+
+void del_expired(const std::string_view kx, const uint32_t now) {
+    del_hashed(kx, hash(kx), now);
+}
+
+// batches run in windows : hash every key, touch its home ctrl group, then the slots its
+// tag hits, and only then run the ops ; the cache misses of a window overlap
+template<typename Keys, typename Op>
+static void batched(const Keys& keys, Op op) {
+    uint64_t hs[BATCH_WINDOW];
+
+    for (size_t w = 0; w < keys.size(); w += BATCH_WINDOW) {
+        const size_t n = std::min(BATCH_WINDOW, keys.size() - w);
+        for (size_t i = 0; i < n; i++) hs[i] = hash(keys[w + i]);
+
+        {
+            const OpGuard g;
+            const Table* t = protect_table();
+            const size_t gmask = t->cap / GROUP_WIDTH - 1;
+
+            for (size_t i = 0; i < n; i++) {
+                __builtin_prefetch(&t->ctrl[(hs[i] & gmask) * GROUP_WIDTH]);
+            }
+            for (size_t i = 0; i < n; i++) {
+                const size_t base = (hs[i] & gmask) * GROUP_WIDTH;
+                const Group grp(&t->ctrl[base]);
+                for (const size_t b : grp.match(tag_of(hs[i]))) __builtin_prefetch(&t->slots[base + b]);
+            }
         }
-        clear_hp(K);
-        continue;
+
+        for (size_t i = 0; i < n; i++) op(w + i, hs[i]);
     }
-}
\ No newline at end of file
+}
+
+template<typename K>
+static size_t mget_of(const vector<K>& keys, vector<string>& vals, vector<uint8_t>& found) {
+    vals.resize(keys.size());
+    found.assign(keys.size(), 0);
+    size_t hits = 0;
+    batched(keys, [&](const size_t i, const uint64_t h) {
+        found[i] = get_hashed(keys[i], h, vals[i]);
+        hits += found[i];
+    });
+    return hits;
+}
+
+template<typename K, typename V>
+static void mset_of(const vector<K>& keys, const vector<V>& vals) {
+    batched(keys, [&](const size_t i, const uint64_t h) {
+        set_hashed(keys[i], h, vals[i], TTL_NEVER);
+        make_room();
+    });
+}
+
+template<typename K>
+static void mdel_of(const vector<K>& keys) {
+    batched(keys, [&](const size_t i, const uint64_t h) { del_hashed(keys[i], h, TTL_NEVER); });
+}
+
+size_t mget(const vector<string>& keys, vector<string>& vals, vector<uint8_t>& found) {
+    return mget_of(keys, vals, found);
+}
+
+size_t mget(const vector<std::string_view>& keys, vector<string>& vals, vector<uint8_t>& found) {
+    return mget_of(keys, vals, found);
+}
+
+void mset(const vector<string>& keys, const vector<string>& vals) {
+    mset_of(keys, vals);
+}
+
+void mset(const vector<std::string_view>& keys, const vector<std::string_view>& vals) {
+    mset_of(keys, vals);
+}
+
+void mdel(const vector<string>& keys) {
+    mdel_of(keys);
+}
+
+void mdel(const vector<std::string_view>& keys) {
+    mdel_of(keys);
+}
@@ -0,0 +1,155 @@
+#include "include/resize.h"
+#include "include/reclaim.h"
+#include "include/slot.h"
+#include "include/group.h"
+#include "include/hash.h"
+#include <algorithm>
+#include <thread>
+
+Table::~Table() {
+    for (auto& slot : slots) {
+        blob_free(ool(slot.kn.load(relaxed), slot.kw[0].load(relaxed)));
+        blob_free(ool(slot.vn.load(relaxed), slot.vw[0].load(relaxed)));
+    }
+}
+
+Table* protect_table() {
+    Table* t = protect(*my_tb, T);
+    Table* n = t->next.load(acquire);
+    if (n != nullptr) help_migrate(t, n);
+    return t;
+}
+
+bool advance(Table*& t) {
+    Table* n = t->next.load(acquire);
+    if (n == nullptr) return false;
+
+    // n is only retired once the root has moved past it
+    hazard(T, n);
+    Table* cur = t->root->load(acquire);
+    t = (cur == t || cur == n) ? n : protect_table();
+    return true;
+}
+
+void start_resize(Table* t) {
+    if (t->root->load(acquire) != t) return;
+    if (t->next.load(acquire) != nullptr) return;
+
+    // size for twice the live keys ; tombstones are dropped on the way over
+    const size_t live = t->live.load(relaxed);
+    size_t cap = INIT_CAPACITY;
+    while (cap < live * 2) cap <<= 1;
+
+    // migrated keys are counted up front so writers can't crowd them out
+    auto* n = new Table(cap, t->root);
+    n->used.store(live, relaxed);
+    Table* expected = nullptr;
+    if (!t->next.compare_exchange_strong(expected, n, seq_cst)) delete n;
+}
+
+bool place(Table* n, const uint64_t h, const Packed& pk, const Packed& pv, const uint32_t exp) {
+    const std::string_view k = view(pk);
+    const size_t y = h;
+    const size_t step = step_of(h);
+    const uint8_t tag = tag_of(h);
+    const size_t gmask = n->cap / GROUP_WIDTH - 1;
+
+    restart:
+    size_t free_i = n->cap;
+
+    for (size_t j = 0; j <= gmask; j++) {
+        const size_t base = ((y + j * step) & gmask) * GROUP_WIDTH;
+        const Group grp(&n->ctrl[base]);
+
+        for (const size_t b : grp.match(tag)) {
+            auto& slot = n->slots[base + b];
+            const char Si = slot.s.load(acquire);
+            if (Si != 'F' && Si != 'U') continue;
+
+            uint32_t ver;
+            int m;
+            do m = match_key(slot, pk, k, ver); while (m < 0);
+            clear_hp(K);
+
+            // a newer write already landed in n
+            if (m == 1) return false;
+        }
+
+        if (free_i == n->cap) free_i = first_free(n, base, grp);
+        if (ends_chain(n, base, grp)) break;
+    }
+
+    if (free_i == n->cap) throw std::runtime_error("Resize target full!");
+
+    auto& slot = n->slots[free_i];
+    char expected = slot.s.load(acquire);
+    if (expected != 'E' && expected != 'D') goto restart;
+    if (!slot.s.compare_exchange_strong(expected, 'I', acq_rel, relaxed)) goto restart;
+
+    begin_write(slot);
+    store_packed(slot.kn, slot.kw, pk);
+    store_packed(slot.vn, slot.vw, pv);
+    slot.exp.store(exp, relaxed);
+    end_write(slot);
+    n->ctrl[free_i].store(tag, relaxed);
+    release_slot(slot, 'F');
+    n->live.fetch_add(1, relaxed);
+    return true;
+}
+
+static void migrate_slot(Table* t, Table* n, const size_t i) {
+    auto& slot = t->slots[i];
+    auto& CPSi = slot.s;
+
+    while (true) {
+        // seq_cst pairs with the next check writers make after claiming E/D
+        char Si = CPSi.load(seq_cst);
+
+        // E/D stay behind ; writers see t->next and go to n instead
+        if (Si == 'E' || Si == 'D' || Si == 'M') return;
+
+        // I/U/X are short lived
+        if (Si != 'F') {
+            std::this_thread::yield();
+            continue;
+        }
+
+        if (!CPSi.compare_exchange_strong(Si, 'P', acq_rel, relaxed)) continue;
+
+        // readers keep using k/v while pinned ; they move to n once 'M'
+        const Packed pk = load_packed(slot.kn, slot.kw);
+        const Packed pv = load_packed(slot.vn, slot.vw);
+        const uint32_t exp = slot.exp.load(relaxed);
+
+        // expired keys stay behind with the tombstones
+        const bool moved = exp > ttl_now.load(relaxed) && place(n, hash(view(pk)), pk, pv, exp);
+
+        // long keys/values now belong to n ; unhook them here
+        begin_write(slot);
+        slot.kn.store(0, relaxed);
+        slot.vn.store(0, relaxed);
+        end_write(slot);
+        release_slot(slot, 'M');
+        t->ctrl[i].store(CTRL_DELETED, relaxed);
+        if (!moved) {
+            kv_bytes.fetch_sub(footprint(view(pk).size(), view(pv).size()), relaxed);
+            retire(ool(pk.n, pk.w[0]));
+            retire(ool(pv.n, pv.w[0]));
+        }
+        return;
+    }
+}
+
+void help_migrate(Table* t, Table* n) {
+    const size_t begin = t->claimed.fetch_add(MIGRATE_CHUNK, relaxed);
+    if (begin >= t->cap) return;
+    const size_t end = std::min(begin + MIGRATE_CHUNK, t->cap);
+
+    for (size_t i = begin; i < end; i++) migrate_slot(t, n, i);
+
+    // last chunk in ; publish n
+    if (t->migrated.fetch_add(end - begin, acq_rel) + (end - begin) == t->cap) {
+        Table* expected = t;
+        if (t->root->compare_exchange_strong(expected, n, acq_rel)) retire(t);
+    }
+}
@@ -0,0 +1,204 @@
+#include "include/slab.h"
+#include "include/metrics.h"
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <thread>
+
+// blocks come from the calling thread's cache ; frees go back to the freeing thread's cache,
+// which for table payloads is whoever ran freeScan on them
+// caches trade whole batches with a per-class depot, so the shared path runs once per SLAB_BATCH
+
+constexpr size_t SLAB_CHUNK = 64 * 1024;    // carved into blocks of any class
+constexpr size_t SLAB_BATCH = 64;           // blocks per depot trade
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+struct ClassCache {
+    FreeBlock* head{nullptr};
+    size_t count{0};
+};
+
+struct Batch {
+    FreeBlock* head;
+    size_t count;
+};
+
+struct Depot {
+    std::atomic_flag lock;
+    vector<Batch> batches;
+};
+
+// smallest class that fits, by 16-byte step
+constexpr auto CLASS_OF = [] {
+    std::array<uint8_t, SLAB_SIZES.back() / 16 + 1> t{};
+    size_t c = 0;
+    for (size_t i = 0; i < t.size(); i++) {
+        while (SLAB_SIZES[c] < i * 16) c++;
+        t[i] = static_cast<uint8_t>(c);
+    }
+    return t;
+}();
+
+static Depot depots[SLAB_CLASSES];
+static atomic<size_t> arena_bytes{0};
+static atomic<int64_t> stray_bytes[SLAB_CLASSES + 1];   // threads without an hp index
+
+static thread_local ClassCache caches[SLAB_CLASSES];
+static thread_local char* carve_ptr = nullptr;
+static thread_local char* carve_end = nullptr;
+
+static void account(const int cls, const int64_t bytes) {
+    if (my_hp_index < 0) {
+        stray_bytes[cls].fetch_add(bytes, relaxed);
+        return;
+    }
+    // owner-only writer ; readers just sum
+    auto& b = slab_stats[my_hp_index].bytes[cls];
+    b.store(b.load(relaxed) + bytes, relaxed);
+}
+
+static void lock(Depot& d) {
+    while (d.lock.test_and_set(acquire)) std::this_thread::yield();
+}
+
+static void unlock(Depot& d) {
+    d.lock.clear(release);
+}
+
+static void push_batch(const int cls, const Batch batch) {
+    auto& d = depots[cls];
+    lock(d);
+    d.batches.push_back(batch);
+    unlock(d);
+}
+
+static bool pop_batch(const int cls, Batch& batch) {
+    auto& d = depots[cls];
+    lock(d);
+    const bool ok = !d.batches.empty();
+    if (ok) {
+        batch = d.batches.back();
+        d.batches.pop_back();
+    }
+    unlock(d);
+    return ok;
+}
+
+static FreeBlock* carve(const size_t size) {
+    if (static_cast<size_t>(carve_end - carve_ptr) < size) {
+        carve_ptr = static_cast<char*>(::operator new(SLAB_CHUNK));
+        carve_end = carve_ptr + SLAB_CHUNK;
+        arena_bytes.fetch_add(SLAB_CHUNK, relaxed);
+    }
+    auto* blk = reinterpret_cast<FreeBlock*>(carve_ptr);
+    carve_ptr += size;
+    return blk;
+}
+
+static void* slab_alloc(const int cls) {
+    auto& c = caches[cls];
+    if (c.head == nullptr) {
+        Batch batch;
+        if (pop_batch(cls, batch)) {
+            c.head = batch.head;
+            c.count = batch.count;
+        } else {
+            c.head = carve(SLAB_SIZES[cls]);
+            c.head->next = nullptr;
+            c.count = 1;
+        }
+    }
+    FreeBlock* blk = c.head;
+    c.head = blk->next;
+    c.count--;
+    return blk;
+}
+
+static void slab_free(void* p, const int cls) {
+    auto& c = caches[cls];
+    auto* blk = static_cast<FreeBlock*>(p);
+    blk->next = c.head;
+    c.head = blk;
+    c.count++;
+
+    // keep one batch warm, hand the next one back
+    if (c.count >= 2 * SLAB_BATCH) {
+        FreeBlock* tail = c.head;
+        for (size_t i = 1; i < SLAB_BATCH; i++) tail = tail->next;
+        push_batch(cls, {c.head, SLAB_BATCH});
+        c.head = tail->next;
+        tail->next = nullptr;
+        c.count -= SLAB_BATCH;
+    }
+}
+
+Blob* blob_new(const std::string_view src) {
+    const size_t size = sizeof(Blob) + src.size();
+    Blob* b;
+
+    if (size > SLAB_SIZES.back()) {
+        b = static_cast<Blob*>(::operator new(size));
+        b->cls = SLAB_CLASSES;
+        account(SLAB_CLASSES, static_cast<int64_t>(size));
+    } else {
+        const int cls = CLASS_OF[(size + 15) / 16];
+        b = static_cast<Blob*>(slab_alloc(cls));
+        b->cls = static_cast<uint8_t>(cls);
+        account(cls, SLAB_SIZES[cls]);
+    }
+
+    b->len = static_cast<uint32_t>(src.size());
+    std::memcpy(b->data(), src.data(), src.size());
+    return b;
+}
+
+void blob_free(Blob* b) {
+    if (b == nullptr) return;
+
+    if (b->cls == SLAB_CLASSES) {
+        account(SLAB_CLASSES, -static_cast<int64_t>(sizeof(Blob) + b->len));
+        ::operator delete(b);
+        return;
+    }
+    account(b->cls, -static_cast<int64_t>(SLAB_SIZES[b->cls]));
+    slab_free(b, b->cls);
+}
+
+// thread exit ; cached blocks go back to the depot for the next thread
+void slab_release_cache() {
+    for (int cls = 0; cls < SLAB_CLASSES; cls++) {
+        auto& c = caches[cls];
+        if (c.count > 0) push_batch(cls, {c.head, c.count});
+        c = {};
+    }
+}
+
+string get_slab_metrics() {
+    int64_t bytes[SLAB_CLASSES + 1];
+    for (int cls = 0; cls <= SLAB_CLASSES; cls++) bytes[cls] = stray_bytes[cls].load(relaxed);
+    slab_stats.for_each([&](const SlabStats& s) {
+        for (int cls = 0; cls <= SLAB_CLASSES; cls++) bytes[cls] += s.bytes[cls].load(relaxed);
+    });
+
+    int64_t total = 0;
+    for (const int64_t b : bytes) total += b;
+
+    std::ostringstream oss;
+    oss << "\n    Slab:\n";
+    oss << "    Summary: in use=" << format_number(total) << "B"
+        << " | arena=" << format_number(arena_bytes.load(relaxed)) << "B\n";
+
+    for (int cls = 0; cls <= SLAB_CLASSES; cls++) {
+        if (bytes[cls] == 0) continue;
+        if (cls == SLAB_CLASSES) {
+            oss << "    large: " << format_number(bytes[cls]) << "B\n";
+        } else {
+            oss << "    " << std::setw(5) << SLAB_SIZES[cls] << ": " << format_number(bytes[cls]) << "B"
+                << " (" << bytes[cls] / SLAB_SIZES[cls] << " blocks)\n";
+        }
+    }
+    return oss.str();
+}
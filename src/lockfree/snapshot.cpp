@@ -0,0 +1,306 @@
+#include "include/snapshot.h"
+#include "include/reclaim.h"
+#include "include/resize.h"
+#include "include/slot.h"
+#include "include/hash.h"
+#include "include/backoff.h"
+#include "include/ttl.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+constexpr char SNAP_MAGIC[8] = {'Z', 'O', 'O', 'M', 'S', 'N', 'P', '2'};
+constexpr size_t SNAP_BLOCK = 64 * 1024;   // record bytes before a block is cut
+
+static atomic<bool> snapshot_running{false};
+
+static void write_all(const int fd, const char* p, size_t n) {
+    while (n > 0) {
+        const ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w < 0) throw std::runtime_error("snapshot write failed");
+        p += w;
+        n -= w;
+    }
+}
+
+struct SnapWriter : KvSink {
+    int fd;
+    uint64_t off{sizeof(SnapHeader)};
+    uint64_t keys{0};
+    vector<uint64_t> index;
+    string block;
+    uint32_t n{0};
+
+    explicit SnapWriter(const int fd) : fd(fd) {}
+
+    void add(const string& k, const string& v, const uint32_t exp) override {
+        const uint32_t head[3] = {static_cast<uint32_t>(k.size()), static_cast<uint32_t>(v.size()), exp};
+        block.append(reinterpret_cast<const char*>(head), sizeof(head));
+        block += k;
+        block += v;
+        n++;
+        keys++;
+        if (block.size() >= SNAP_BLOCK) cut();
+    }
+
+    void cut() {
+        if (n == 0) return;
+        const SnapBlock b{n, static_cast<uint32_t>(block.size())};
+        write_all(fd, reinterpret_cast<const char*>(&b), sizeof(b));
+        write_all(fd, block.data(), block.size());
+        index.push_back(off);
+        off += sizeof(b) + block.size();
+        block.clear();
+        n = 0;
+    }
+};
+
+static bool keyed(const char s) {
+    return s == 'F' || s == 'U' || s == 'P';
+}
+
+// every keyed slot of t ; a P slot still holds its k/v, an M slot turns up again in t->next
+static void walk_table(const Table* t, KvSink& w) {
+    string k, v;
+    for (const auto& slot : t->slots) {
+        while (keyed(slot.s.load(acquire))) {
+            uint32_t exp, ver;
+            if (!read_kv(slot, k, v, exp, ver)) {
+                cpu_relax();
+                continue;
+            }
+
+            // still keyed at that version ; else it was deleted or moved as we read
+            if (!keyed(slot.s.load(acquire))) break;
+            if (slot.ver.load(acquire) != ver) continue;
+
+            if (exp > ttl_now.load(relaxed)) w.add(k, v, exp);
+            break;
+        }
+    }
+    clear_hp_both();
+}
+
+// the table and then every resize target under it
+static void walk_root(atomic<Table*>& root, KvSink& w) {
+    const OpGuard g;
+    Table* t = protect(root, T);
+
+    while (true) {
+        walk_table(t, w);
+        Table* n = t->next.load(acquire);
+        if (n == nullptr) return;
+
+        // n is only retired once the root has moved past it
+        hazard(T, n);
+        Table* cur = root.load(acquire);
+        t = (cur == t || cur == n) ? n : protect(root, T);
+    }
+}
+
+void walk_roots(const vector<atomic<Table*>*>& roots, KvSink& sink) {
+    for (atomic<Table*>* root : roots) walk_root(*root, sink);
+}
+
+size_t snapshot_save(const vector<atomic<Table*>*>& roots, const string& path) {
+    get_my_hp_index();
+
+    const string tmp = path + ".tmp";
+    const int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) throw std::runtime_error("snapshot open failed: " + tmp);
+
+    try {
+        SnapWriter w(fd);
+        SnapHeader h{};
+        write_all(fd, reinterpret_cast<const char*>(&h), sizeof(h));
+
+        walk_roots(roots, w);
+        w.cut();
+        write_all(fd, reinterpret_cast<const char*>(w.index.data()), w.index.size() * sizeof(uint64_t));
+
+        std::memcpy(h.magic, SNAP_MAGIC, sizeof(h.magic));
+        h.keys = w.keys;
+        h.blocks = w.index.size();
+        h.index = w.off;
+        if (pwrite(fd, &h, sizeof(h), 0) != sizeof(h)) throw std::runtime_error("snapshot write failed");
+        if (fsync(fd) < 0) throw std::runtime_error("snapshot fsync failed");
+        close(fd);
+
+        if (rename(tmp.c_str(), path.c_str()) < 0) throw std::runtime_error("snapshot rename failed: " + path);
+        return w.keys;
+    }
+    catch (...) {
+        close(fd);
+        unlink(tmp.c_str());
+        throw;
+    }
+}
+
+bool snapshot_begin(const vector<atomic<Table*>*>& roots, const string& path) {
+    if (snapshot_running.exchange(true, acq_rel)) return false;
+
+    std::thread([roots, path] {
+        try {
+            const size_t keys = snapshot_save(roots, path);
+            std::cout << "snapshot: " << keys << " keys to " << path << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "snapshot: " << e.what() << "\n";
+        }
+        release_hp_index();
+        snapshot_running.store(false, release);
+    }).detach();
+    return true;
+}
+
+// a record where the loader found it ; p is at its klen
+struct SnapRec {
+    uint64_t h;
+    const char* p;
+};
+
+static void rec_at(const char* p, std::string_view& k, std::string_view& v, uint32_t& exp) {
+    uint32_t head[3];
+    std::memcpy(head, p, sizeof(head));
+    k = {p + sizeof(head), head[0]};
+    v = {p + sizeof(head) + head[0], head[1]};
+    exp = head[2];
+}
+
+template<typename F>
+static void on_threads(const int n, F fn) {
+    vector<std::thread> ts;
+    for (int i = 0; i < n; i++) ts.emplace_back(fn, i);
+    for (auto& t : ts) t.join();
+}
+
+size_t snapshot_load(const string& path, const vector<atomic<Table*>*>& roots, const SnapRoute route, const int threads) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw std::runtime_error("snapshot open failed: " + path);
+    struct stat st{};
+    fstat(fd, &st);
+    const auto size = static_cast<size_t>(st.st_size);
+    if (size < sizeof(SnapHeader)) {
+        close(fd);
+        throw std::runtime_error("snapshot too short: " + path);
+    }
+
+    void* map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) throw std::runtime_error("snapshot mmap failed: " + path);
+    madvise(map, size, MADV_WILLNEED);
+    const auto* base = static_cast<const char*>(map);
+
+    SnapHeader h;
+    std::memcpy(&h, base, sizeof(h));
+    if (std::memcmp(h.magic, SNAP_MAGIC, sizeof(h.magic)) != 0 || h.index > size || (size - h.index) / sizeof(uint64_t) < h.blocks) {
+        munmap(map, size);
+        throw std::runtime_error("not a snapshot: " + path);
+    }
+    vector<uint64_t> index(h.blocks);
+    std::memcpy(index.data(), base + h.index, h.blocks * sizeof(uint64_t));
+
+    // a key goes to one partition, so one loader sees every copy of it
+    const int W = std::max(1, threads);
+    const size_t R = roots.size();
+    const auto part_of = [W](const uint64_t hh) { return static_cast<int>((hh >> 20) % W); };
+
+    // hash ; worker w takes a contiguous run of blocks, so each part stays in file order
+    vector<vector<vector<SnapRec>>> parts(W, vector<vector<SnapRec>>(W));
+    vector<vector<size_t>> per_root(W, vector<size_t>(R));
+    atomic<bool> bad{false};
+
+    on_threads(W, [&](const int w) {
+        for (size_t b = h.blocks * w / W; b < h.blocks * (w + 1) / W; b++) {
+            SnapBlock sb;
+            if (index[b] + sizeof(sb) > h.index) { bad = true; return; }
+            std::memcpy(&sb, base + index[b], sizeof(sb));
+            const char* p = base + index[b] + sizeof(sb);
+            const char* end = p + sb.bytes;
+            if (end > base + h.index) { bad = true; return; }
+
+            for (uint32_t i = 0; i < sb.n; i++) {
+                std::string_view k, v;
+                uint32_t exp;
+                if (p + 3 * sizeof(uint32_t) > end) { bad = true; return; }
+                rec_at(p, k, v, exp);
+                if (v.data() + v.size() > end) { bad = true; return; }
+
+                const uint64_t hh = hash(k);
+                parts[w][part_of(hh)].push_back({hh, p});
+                per_root[w][route(hh)]++;
+                p = v.data() + v.size();
+            }
+        }
+    });
+    if (bad) {
+        munmap(map, size);
+        throw std::runtime_error("snapshot truncated: " + path);
+    }
+
+    // sized like a resize target ; nothing grows while loading
+    vector<Table*> fresh(R);
+    for (size_t r = 0; r < R; r++) {
+        size_t keys = 0;
+        for (int w = 0; w < W; w++) keys += per_root[w][r];
+        size_t cap = INIT_CAPACITY;
+        while (cap < keys * 2) cap <<= 1;
+        fresh[r] = new Table(cap, roots[r]);
+    }
+
+    // keys with a deadline, tracked once their table is the one the expiry thread sees
+    struct Due {
+        std::string_view k;
+        atomic<Table*>* root;
+        uint32_t exp;
+    };
+    vector<vector<Due>> dues(W);
+
+    // place ; newest copy first, so place() keeps it and turns the older ones away
+    atomic<size_t> loaded{0};
+    on_threads(W, [&](const int d) {
+        get_my_hp_index();
+        size_t mine = 0;
+        for (int w = W - 1; w >= 0; w--) {
+            const auto& part = parts[w][d];
+            for (auto it = part.rbegin(); it != part.rend(); ++it) {
+                std::string_view k, v;
+                uint32_t exp;
+                rec_at(it->p, k, v, exp);
+                const Packed pk = pack_owned(k);
+                const Packed pv = pack_owned(v);
+                atomic<Table*>* root = roots[route(it->h)];
+                if (place(fresh[route(it->h)], it->h, pk, pv, exp)) {
+                    if (exp != TTL_NEVER) dues[d].push_back({k, root, exp});
+                    kv_bytes.fetch_add(footprint(k.size(), v.size()), relaxed);
+                    mine++;
+                }
+                else {
+                    blob_free(ool(pk.n, pk.w[0]));
+                    blob_free(ool(pv.n, pv.w[0]));
+                }
+            }
+        }
+        loaded.fetch_add(mine, relaxed);
+        release_hp_index();
+    });
+
+    // the expiry thread may be in the old tables already
+    for (size_t r = 0; r < R; r++) {
+        fresh[r]->used.store(fresh[r]->live.load(relaxed), relaxed);
+        retire(roots[r]->exchange(fresh[r], acq_rel));
+    }
+    for (const auto& part : dues) {
+        for (const Due& e : part) ttl_track(e.k, e.root, e.exp);
+    }
+    munmap(map, size);
+    return loaded.load();
+}
@@ -0,0 +1,146 @@
+#include "include/trace.h"
+#include "include/reclaim.h"
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+
+static atomic<Ticks> trace_since{0};        // events that started before this are left out
+static atomic<bool> dump_running{false};
+
+static const char* const TRACE_NAMES[TRACE_SPIN + 1] = {
+    "E→I→F insert", "D→I→F insert", "F→U→F update", "F→U→F abort", "F→U→D abort",
+    "F→X→D delete", "F→X→D abort", "spin",
+};
+
+void trace_event(const uint8_t kind, const size_t slot, const Ticks start, const Ticks end, const int spins) {
+    TraceRing& r = trace_rings[my_hp_index];
+    TraceEvent* ev = r.ev.load(relaxed);
+    if (ev == nullptr) {
+        ev = new TraceEvent[TRACE_RING];
+        r.ev.store(ev, release);
+    }
+
+    const uint64_t h = r.head.load(relaxed);
+    TraceEvent& e = ev[h & (TRACE_RING - 1)];
+    const uint64_t dur = std::min<uint64_t>(end > start ? ticks_to_ns(end - start) : 0, UINT32_MAX);
+
+    e.seq.store(2 * h + 1, relaxed);
+    std::atomic_thread_fence(release);
+    e.ts.store(start, relaxed);
+    e.dur_slot.store(dur << 32 | static_cast<uint32_t>(slot), relaxed);
+    e.kind_spins.store(uint64_t{kind} << 32 | static_cast<uint32_t>(spins), relaxed);
+    e.seq.store(2 * h + 2, release);
+    r.head.store(h + 1, relaxed);
+}
+
+void trace_enable(const bool on) {
+    if (on) trace_since.store(ticks(), relaxed);
+    trace_on.store(on, relaxed);
+}
+
+// a settled copy of one event
+struct Traced {
+    Ticks ts;
+    uint64_t dur_slot;
+    uint64_t kind_spins;
+};
+
+// e as it stood, unless its thread was rewriting it meanwhile
+static bool copy_event(const TraceEvent& e, Traced& out) {
+    const uint64_t s1 = e.seq.load(acquire);
+    if (s1 == 0 || s1 & 1) return false;
+    out.ts = e.ts.load(relaxed);
+    out.dur_slot = e.dur_slot.load(relaxed);
+    out.kind_spins = e.kind_spins.load(relaxed);
+    std::atomic_thread_fence(acquire);
+    return e.seq.load(relaxed) == s1;
+}
+
+// ts and dur in us, to the ns
+static void put_us(string& out, const uint64_t ns) {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%llu.%03llu",
+                  static_cast<unsigned long long>(ns / 1000), static_cast<unsigned long long>(ns % 1000));
+    out += buf;
+}
+
+// n is the events in it, thread names aside
+static string render(size_t& n) {
+    const uint64_t since = trace_since.load(relaxed);
+
+    // each thread's events, oldest first
+    vector<vector<Traced>> threads;
+    Ticks t_min = UINT64_MAX;
+    trace_rings.for_each([&](const TraceRing& r) {
+        vector<Traced>& mine = threads.emplace_back();
+        const TraceEvent* ev = r.ev.load(acquire);
+        if (ev == nullptr) return;
+        const uint64_t h = r.head.load(relaxed);
+        for (uint64_t i = h > TRACE_RING ? h - TRACE_RING : 0; i < h; i++) {
+            Traced t;
+            if (!copy_event(ev[i & (TRACE_RING - 1)], t) || t.ts < since) continue;
+            mine.push_back(t);
+            t_min = std::min(t_min, t.ts);
+        }
+    });
+
+    n = 0;
+    string out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    bool first = true;
+    for (size_t tid = 0; tid < threads.size(); tid++) {
+        if (threads[tid].empty()) continue;
+        if (!first) out += ',';
+        first = false;
+        out += "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + std::to_string(tid)
+             + ",\"args\":{\"name\":\"thread " + std::to_string(tid) + "\"}}";
+
+        n += threads[tid].size();
+        for (const Traced& t : threads[tid]) {
+            const auto kind = static_cast<uint8_t>(t.kind_spins >> 32);
+            out += ",\n{\"name\":\"";
+            out += TRACE_NAMES[std::min<uint8_t>(kind, TRACE_SPIN)];
+            out += "\",\"cat\":\"slot\",\"ph\":\"X\",\"pid\":1,\"tid\":" + std::to_string(tid) + ",\"ts\":";
+            put_us(out, ticks_to_ns(t.ts - t_min));
+            out += ",\"dur\":";
+            put_us(out, t.dur_slot >> 32);
+            out += ",\"args\":{\"slot\":" + std::to_string(static_cast<uint32_t>(t.dur_slot))
+                 + ",\"spins\":" + std::to_string(static_cast<uint32_t>(t.kind_spins)) + "}}";
+        }
+    }
+    out += "\n]}\n";
+    return out;
+}
+
+string trace_json() {
+    size_t n;
+    return render(n);
+}
+
+size_t trace_dump(const string& path) {
+    size_t n;
+    const string json = render(n);
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    if (!f) throw std::runtime_error("trace open failed: " + path);
+    f.write(json.data(), static_cast<std::streamsize>(json.size()));
+    if (!f) throw std::runtime_error("trace write failed: " + path);
+    return n;
+}
+
+bool trace_dump_begin(const string& path) {
+    if (dump_running.exchange(true, acq_rel)) return false;
+
+    std::thread([path] {
+        try {
+            const size_t n = trace_dump(path);
+            std::cout << "trace: " << n << " events to " << path << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << "trace: " << e.what() << "\n";
+        }
+        dump_running.store(false, release);
+    }).detach();
+    return true;
+}
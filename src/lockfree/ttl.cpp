@@ -0,0 +1,111 @@
+#include "include/ttl.h"
+#include "include/reclaim.h"
+#include "include/ops.h"
+#include <thread>
+#include <utility>
+
+constexpr uint32_t WHEEL_SIZE = 1u << WHEEL_BITS;
+constexpr uint32_t WHEEL_MASK = WHEEL_SIZE - 1;
+
+static bool ttl_on = false;     // set by ttl_start before any traffic
+
+// expiry thread only
+static vector<TtlEntry> wheel[WHEEL_LEVELS][WHEEL_SIZE];
+static vector<TtlEntry> far;    // past the top level ; looked at again each time it turns over
+static vector<TtlEntry> due;
+static uint32_t wheel_now = 0;  // last second the wheel has handled
+
+static uint32_t wall_now() {
+    return chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+}
+
+uint32_t ttl_deadline(const uint32_t ex) {
+    // part of this second is gone already ; count from the next one
+    const uint64_t at = uint64_t{wall_now()} + 1 + ex;
+    return at >= TTL_NEVER ? TTL_NEVER - 1 : static_cast<uint32_t>(at);
+}
+
+void ttl_track(const std::string_view k, atomic<Table*>* root, const uint32_t at) {
+    if (!ttl_on) return;
+    TtlBuf& b = ttl_bufs[get_my_hp_index()];
+    while (b.lock.test_and_set(acquire)) std::this_thread::yield();
+    b.pending.push_back({string(k), root, at});
+    b.lock.clear(release);
+}
+
+// level l buckets are 2^(WHEEL_BITS * l) seconds wide ; an entry goes to the lowest level
+// that reaches its deadline, in the bucket its deadline's bits for that level pick
+static void wheel_add(TtlEntry&& e) {
+    if (e.at <= wheel_now) {
+        due.push_back(std::move(e));
+        return;
+    }
+    const uint64_t delta = e.at - wheel_now;
+    for (int l = 0; l < WHEEL_LEVELS; l++) {
+        if (delta < uint64_t{1} << WHEEL_BITS * (l + 1)) {
+            wheel[l][(e.at >> WHEEL_BITS * l) & WHEEL_MASK].push_back(std::move(e));
+            return;
+        }
+    }
+    far.push_back(std::move(e));
+}
+
+// a bucket whose span just started goes down a level or more
+static void cascade(vector<TtlEntry>& bucket) {
+    vector<TtlEntry> moving;
+    moving.swap(bucket);
+    for (TtlEntry& e : moving) wheel_add(std::move(e));
+}
+
+// one second on ; what's due lands in due
+static void tick() {
+    wheel_now++;
+    if ((wheel_now & ((uint64_t{1} << WHEEL_BITS * WHEEL_LEVELS) - 1)) == 0) cascade(far);
+    for (int l = WHEEL_LEVELS - 1; l >= 1; l--) {
+        if ((wheel_now & ((1u << WHEEL_BITS * l) - 1)) != 0) continue;
+        cascade(wheel[l][(wheel_now >> WHEEL_BITS * l) & WHEEL_MASK]);
+    }
+    vector<TtlEntry>& now = wheel[0][wheel_now & WHEEL_MASK];
+    for (TtlEntry& e : now) due.push_back(std::move(e));
+    now.clear();
+}
+
+// every thread's new deadlines into the wheel ; a swap under each lock
+static void drain() {
+    static vector<TtlEntry> spare;
+    ttl_bufs.for_each([&](TtlBuf& b) {
+        while (b.lock.test_and_set(acquire)) std::this_thread::yield();
+        b.pending.swap(spare);
+        b.lock.clear(release);
+        for (TtlEntry& e : spare) wheel_add(std::move(e));
+        spare.clear();
+    });
+}
+
+// a key set again since it was tracked has a later exp, or none, and stays
+[[noreturn]] static void expirer() {
+    get_my_hp_index();
+    while (true) {
+        std::this_thread::sleep_for(chrono::milliseconds(TTL_TICK_MS));
+
+        // never backwards ; a key that read as expired stays that way
+        const uint32_t now = wall_now();
+        if (now > ttl_now.load(relaxed)) ttl_now.store(now, relaxed);
+
+        drain();
+        while (wheel_now < ttl_now.load(relaxed)) tick();
+
+        for (TtlEntry& e : due) {
+            my_tb = e.root;
+            del_expired(e.key, wheel_now);
+        }
+        due.clear();
+    }
+}
+
+void ttl_start() {
+    wheel_now = wall_now();
+    ttl_now.store(wheel_now, relaxed);
+    ttl_on = true;
+    std::thread(expirer).detach();
+}
@@ -0,0 +1,159 @@
+#include "include/loop.h"
+#include "reclaim.h"
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+#include <thread>
+
+constexpr int MAX_EVENTS = 256;
+constexpr size_t READ_CHUNK = 16 * 1024;
+constexpr size_t OUT_FLUSH = 64 * 1024;    // send early when a read batch piles up this much
+
+static void close_conn(const int ep, Conn* c) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+    delete c;
+}
+
+// every loop has the listener ; EPOLLEXCLUSIVE wakes one of them per new client
+static void accept_all(const int ep, const int listen_fd) {
+    while (true) {
+        const int fd = accept4(listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;   // EAGAIN, or another loop got it
+
+        const int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        auto* c = new Conn;
+        c->fd = fd;
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.ptr = c;
+        if (epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            delete c;
+        }
+    }
+}
+
+// as much of c->out as the socket takes ; the rest waits for EPOLLOUT. false on a dead peer
+static bool flush(Conn* c) {
+    size_t sent = 0;
+    while (sent < c->out.size()) {
+        const ssize_t n = send(c->fd, c->out.data() + sent, c->out.size() - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+            continue;
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        break;
+    }
+    c->out.erase(0, sent);
+    return true;
+}
+
+// hung up ; alive only while replies are left to send
+static bool drain(Conn* c) {
+    return flush(c) && !c->out.empty();
+}
+
+// edge triggered ; drain until EAGAIN, then one send for every reply in the batch
+// false once the peer is gone
+static bool read_all(Conn* c, const Handler on_data) {
+    char buf[READ_CHUNK];
+    while (true) {
+        const ssize_t n = read(c->fd, buf, sizeof(buf));
+        if (n > 0) {
+            c->in.append(buf, n);
+            on_data(*c);
+            if (c->hangup) return drain(c);
+            if (c->out.size() >= OUT_FLUSH && !flush(c)) return false;
+
+            // not reading its replies ; leave the rest in the socket, EPOLLOUT picks it up
+            if (c->out.size() >= OUT_HIGH) {
+                c->stalled = true;
+                return true;
+            }
+            continue;
+        }
+        // peer is done sending but may still read ; EPOLLOUT sends the rest
+        if (n == 0) {
+            c->hangup = true;
+            return drain(c);
+        }
+        if (errno == EINTR) continue;
+        if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+        return flush(c);
+    }
+}
+
+static char WAKE_TAG;   // data.ptr of the wake fd ; nullptr is the listener, anything else a Conn
+
+[[noreturn]] static void loop(const int listen_fd, const Handler on_data, const int wake_fd = -1, const Waker on_wake = nullptr) {
+    get_my_hp_index();
+
+    const int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0) throw std::runtime_error("epoll_create1 failed");
+
+    epoll_event lev{};
+    lev.events = EPOLLIN | EPOLLEXCLUSIVE;
+    lev.data.ptr = nullptr;
+    epoll_ctl(ep, EPOLL_CTL_ADD, listen_fd, &lev);
+
+    if (wake_fd >= 0) {
+        epoll_event wev{};
+        wev.events = EPOLLIN;
+        wev.data.ptr = &WAKE_TAG;
+        epoll_ctl(ep, EPOLL_CTL_ADD, wake_fd, &wev);
+    }
+
+    epoll_event events[MAX_EVENTS];
+    while (true) {
+        const int n = epoll_wait(ep, events, MAX_EVENTS, -1);
+        for (int i = 0; i < n; i++) {
+            auto* c = static_cast<Conn*>(events[i].data.ptr);
+            if (c == nullptr) {
+                accept_all(ep, listen_fd);
+                continue;
+            }
+            if (events[i].data.ptr == &WAKE_TAG) {
+                uint64_t count;
+                read(wake_fd, &count, sizeof(count));
+                on_wake();
+                continue;
+            }
+            const uint32_t ev = events[i].events;
+            bool alive = !(ev & (EPOLLERR | EPOLLHUP));
+            if (alive && (ev & EPOLLOUT)) alive = c->hangup ? drain(c) : flush(c);
+            if (alive && c->hangup) continue;
+
+            // a stalled client is read again once its replies are all out ; edge triggered,
+            // so that read has to come from here rather than a new EPOLLIN
+            bool readable = ev & EPOLLIN;
+            if (alive && c->stalled) {
+                c->stalled = !c->out.empty();
+                readable = !c->stalled;
+            }
+            if (alive && readable) alive = read_all(c, on_data);
+            if (!alive) close_conn(ep, c);
+        }
+    }
+}
+
+void run_epoll_loops(const int listen_fd, const int threads, const Handler on_data) {
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+
+    for (int i = 1; i < threads; i++) std::thread(loop, listen_fd, on_data, -1, nullptr).detach();
+    loop(listen_fd, on_data);
+}
+
+void run_epoll_loop(const int listen_fd, const Handler on_data, const int wake_fd, const Waker on_wake) {
+    fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    loop(listen_fd, on_data, wake_fd, on_wake);
+}
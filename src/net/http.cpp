@@ -0,0 +1,77 @@
+#include "include/http.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+
+constexpr size_t HTTP_HEAD_MAX = 8 * 1024;     // a scraper's request is a few hundred bytes
+constexpr int HTTP_TIMEOUT_S = 2;              // a client that stalls can't hold the listener
+
+static void send_all(const int fd, const std::string& s) {
+    size_t off = 0;
+    while (off < s.size()) {
+        const ssize_t w = send(fd, s.data() + off, s.size() - off, MSG_NOSIGNAL);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        off += w;
+    }
+}
+
+static std::string response(const char* status, const char* type, const std::string& body) {
+    std::string out = "HTTP/1.0 ";
+    out += status;
+    out += "\r\nContent-Type: ";
+    out += type;
+    out += "\r\nContent-Length: " + std::to_string(body.size());
+    out += "\r\nConnection: close\r\n\r\n";
+    out += body;
+    return out;
+}
+
+// the request line is all we look at ; headers are read and dropped
+static void answer(const int fd, const Render render) {
+    std::string head;
+    char buf[1024];
+    while (head.find("\r\n\r\n") == std::string::npos && head.size() < HTTP_HEAD_MAX) {
+        const ssize_t r = recv(fd, buf, sizeof(buf), 0);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return;
+        head.append(buf, r);
+    }
+
+    const std::string_view line = std::string_view(head).substr(0, head.find("\r\n"));
+    if (line.starts_with("GET /metrics ") || line == "GET /metrics") {
+        send_all(fd, response("200 OK", "text/plain; version=0.0.4; charset=utf-8", render()));
+    }
+    else {
+        send_all(fd, response("404 Not Found", "text/plain", "not found\n"));
+    }
+}
+
+[[noreturn]] static void listener(const int listen_fd, const Render render) {
+    while (true) {
+        const int fd = accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) continue;
+        const timeval tv{HTTP_TIMEOUT_S, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        answer(fd, render);
+        close(fd);
+    }
+}
+
+void serve_metrics(const int port, const Render render) {
+    const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) throw std::runtime_error("metrics bind failed");
+    listen(fd, 16);
+    std::thread(listener, fd, render).detach();
+}
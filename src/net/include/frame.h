@@ -0,0 +1,69 @@
+#pragma once
+
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+// binary protocol ; a connection switches to it with the text line "BINARY" (reply +OK)
+// and stays binary until it closes
+//
+// every request and reply is one frame : a fixed header, then klen key bytes,
+// then vlen value bytes. little endian, no padding between frames
+//
+//   request  GET  key            reply  OK + value | MISS
+//            SET  key value             OK
+//            DEL  key                   OK
+//
+// id is the client's ; replies carry it back so a client may match them out of order.
+// frames back to back in one write are a batch and run through mget/mset/mdel.
+// a frame over FRAME_MAX gets ERR "frame too large" and the connection is closed
+struct FrameHeader {
+    uint32_t id;
+    uint8_t op;         // request : FrameOp | reply : FrameStatus
+    uint8_t pad;
+    uint16_t klen;
+    uint32_t vlen;
+};
+
+static_assert(sizeof(FrameHeader) == 12);
+static_assert(std::endian::native == std::endian::little, "headers are copied as is");
+
+enum FrameOp : uint8_t { OP_GET = 1, OP_SET = 2, OP_DEL = 3 };
+enum FrameStatus : uint8_t { ST_OK = 0, ST_MISS = 1, ST_ERR = 2 };
+
+struct Frame {
+    uint32_t id;
+    uint8_t op;
+    std::string_view key;
+    std::string_view val;
+};
+
+// header, key and value ; a bigger frame is refused from its header, before its bytes come in
+constexpr size_t FRAME_MAX = 64 << 20;
+
+// one whole frame from the front of buf
+// 1 got it | 0 not all of it has arrived | -1 over FRAME_MAX, only f.id is set
+inline int read_frame(const std::string_view buf, Frame& f, size_t& used) {
+    if (buf.size() < sizeof(FrameHeader)) return 0;
+    FrameHeader h;
+    std::memcpy(&h, buf.data(), sizeof(h));
+
+    f.id = h.id;
+    used = sizeof(h) + h.klen + static_cast<size_t>(h.vlen);
+    if (used > FRAME_MAX) return -1;
+    if (buf.size() < used) return 0;
+
+    f.op = h.op;
+    f.key = buf.substr(sizeof(h), h.klen);
+    f.val = buf.substr(sizeof(h) + h.klen, h.vlen);
+    return 1;
+}
+
+inline void put_frame(std::string& out, const uint32_t id, const uint8_t op, const std::string_view key, const std::string_view val) {
+    const FrameHeader h{id, op, 0, static_cast<uint16_t>(key.size()), static_cast<uint32_t>(val.size())};
+    out.append(reinterpret_cast<const char*>(&h), sizeof(h));
+    out += key;
+    out += val;
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+
+// what GET /metrics answers with ; called on the listener thread
+using Render = std::string (*)();
+
+// a one-thread HTTP/1.0 listener for scrapers, off the request loops ; one client at a time,
+// GET /metrics gets render() as text/plain, anything else a 404
+void serve_metrics(int port, Render render);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+constexpr size_t OUT_HIGH = 4 << 20;   // a client with this much unsent isn't read from until it drains
+
+// one client connection, owned by the loop thread that accepted it
+struct Conn {
+    int fd{-1};
+    std::string in;     // bytes read but not yet parsed
+    std::string out;    // replies not yet sent ; one send per read batch
+    uint8_t proto{0};   // the handler's ; which protocol this client speaks
+    bool hangup{false};    // close once the replies so far are sent ; the handler's, or the loop's on EOF
+    bool stalled{false};   // the loop stopped reading until out drains ; see OUT_HIGH
+};
+
+// called on the loop thread with new bytes appended to c.in ; consumes what it can
+// and appends the replies to c.out
+using Handler = void (*)(Conn& c);
+
+// one non-blocking loop per thread over a shared listening socket ; never returns
+// each loop thread holds its reclamation record for its whole life
+[[noreturn]] void run_epoll_loops(int listen_fd, int threads, Handler on_data);
+
+// called on the loop thread when its wake fd (an eventfd) turns readable
+using Waker = void (*)();
+
+// one loop on the calling thread, with its own listener ; never returns
+[[noreturn]] void run_epoll_loop(int listen_fd, Handler on_data, int wake_fd, Waker on_wake);
+
+#ifdef ZOOM_IO_URING
+bool uring_supported();
+[[noreturn]] void run_uring_loops(int listen_fd, int threads, Handler on_data);
+#endif
+
+// io_uring when built with ZOOM_IO_URING and the kernel allows it, else epoll
+[[noreturn]] inline void run_loops(const int listen_fd, const int threads, const Handler on_data) {
+#ifdef ZOOM_IO_URING
+    if (uring_supported()) run_uring_loops(listen_fd, threads, on_data);
+#endif
+    run_epoll_loops(listen_fd, threads, on_data);
+}
@@ -0,0 +1,549 @@
+#include "include/loop.h"
+#include "reclaim.h"
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using std::vector;
+
+// io_uring backend, raw syscalls (no liburing)
+// per loop : one multishot accept on the shared listener, one multishot recv per client,
+// recv buffers picked by the kernel from a provided buffer ring (legacy provided buffers
+// where rings don't work), and a single io_uring_enter per pass that submits everything
+// queued and waits for completions
+
+constexpr unsigned RING_ENTRIES = 1024;
+constexpr unsigned RECV_BUFS = 512;     // power of two
+constexpr unsigned RECV_BUF_SIZE = 4096;
+constexpr uint16_t RECV_GROUP = 0;
+constexpr uint64_t ACCEPT_TAG = 0;      // user_data of the accept
+constexpr uint64_t PROVIDE_TAG = 1;     // buffer hand-backs ; everything else is a UConn*
+constexpr uint64_t PROBE_TAG = 2;       // buf_ring_works' recv ; never reaches the loop
+constexpr uint64_t SEND_BIT = 1;        // set on a UConn* for its send, clear for its recv
+constexpr uint64_t CANCEL_BIT = 2;      // set on a UConn* for the cancel of its recv
+
+static int sys_setup(const unsigned entries, io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sys_enter(const int fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sys_register(const int fd, const unsigned op, void* arg, const unsigned nr) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, op, arg, nr));
+}
+
+template<typename T>
+static T load_acquire(T* p) { return std::atomic_ref<T>(*p).load(std::memory_order_acquire); }
+
+template<typename T>
+static void store_release(T* p, const T v) { std::atomic_ref<T>(*p).store(v, std::memory_order_release); }
+
+struct Ring {
+    int fd{-1};
+    char* ring_mem{nullptr};
+    size_t ring_bytes{0};
+    size_t sqe_bytes{0};
+
+    unsigned* sq_head;
+    unsigned* sq_tail;
+    unsigned sq_mask;
+    unsigned* sq_array;
+    io_uring_sqe* sqes;
+    unsigned sq_entries;
+    unsigned sq_local_tail{0};
+    unsigned queued{0};
+
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned cq_mask;
+    io_uring_cqe* cqes;
+
+    io_uring_buf_ring* bufs{nullptr};
+    bool buf_ring{false};   // else legacy IORING_OP_PROVIDE_BUFFERS
+    char* buf_mem{nullptr};
+    unsigned buf_tail{0};
+};
+
+static bool setup(Ring& r) {
+    io_uring_params p{};
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    r.fd = sys_setup(RING_ENTRIES, &p);
+    if (r.fd < 0) {
+        p = {};
+        r.fd = sys_setup(RING_ENTRIES, &p);
+    }
+    if (r.fd < 0) return false;
+    if (!(p.features & IORING_FEAT_SINGLE_MMAP)) {
+        close(std::exchange(r.fd, -1));
+        return false;
+    }
+
+    const size_t sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    const size_t cq_size = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    r.ring_bytes = std::max(sq_size, cq_size);
+    auto* ring = static_cast<char*>(mmap(nullptr, r.ring_bytes, PROT_READ | PROT_WRITE,
+                                         MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQ_RING));
+    if (ring == MAP_FAILED) {
+        close(std::exchange(r.fd, -1));
+        return false;
+    }
+    r.ring_mem = ring;
+
+    r.sqe_bytes = p.sq_entries * sizeof(io_uring_sqe);
+    r.sqes = static_cast<io_uring_sqe*>(mmap(nullptr, r.sqe_bytes, PROT_READ | PROT_WRITE,
+                                             MAP_SHARED | MAP_POPULATE, r.fd, IORING_OFF_SQES));
+    if (r.sqes == MAP_FAILED) {
+        munmap(ring, r.ring_bytes);
+        close(std::exchange(r.fd, -1));
+        return false;
+    }
+
+    r.sq_head = reinterpret_cast<unsigned*>(ring + p.sq_off.head);
+    r.sq_tail = reinterpret_cast<unsigned*>(ring + p.sq_off.tail);
+    r.sq_mask = *reinterpret_cast<unsigned*>(ring + p.sq_off.ring_mask);
+    r.sq_array = reinterpret_cast<unsigned*>(ring + p.sq_off.array);
+    r.sq_entries = p.sq_entries;
+    r.sq_local_tail = *r.sq_tail;
+
+    r.cq_head = reinterpret_cast<unsigned*>(ring + p.cq_off.head);
+    r.cq_tail = reinterpret_cast<unsigned*>(ring + p.cq_off.tail);
+    r.cq_mask = *reinterpret_cast<unsigned*>(ring + p.cq_off.ring_mask);
+    r.cqes = reinterpret_cast<io_uring_cqe*>(ring + p.cq_off.cqes);
+
+    r.buf_mem = new char[static_cast<size_t>(RECV_BUFS) * RECV_BUF_SIZE];
+    return true;
+}
+
+// hands the queued sqes to the kernel and waits for at least one completion
+static void submit_and_wait(Ring& r) {
+    store_release(r.sq_tail, r.sq_local_tail);
+    const unsigned n = r.queued;
+    r.queued = 0;
+    while (sys_enter(r.fd, n, 1, IORING_ENTER_GETEVENTS) < 0 && errno == EINTR) {}
+}
+
+// the oldest completion past any buffer hand-backs ; only for the probes, which wait for
+// theirs one at a time
+static io_uring_cqe take_cqe(Ring& r) {
+    while (true) {
+        if (*r.cq_head == load_acquire(r.cq_tail)) submit_and_wait(r);
+        const unsigned head = *r.cq_head;
+        const io_uring_cqe cqe = r.cqes[head & r.cq_mask];
+        store_release(r.cq_head, head + 1);
+        if (cqe.user_data != PROVIDE_TAG) return cqe;
+    }
+}
+
+static io_uring_sqe* next_sqe(Ring& r) {
+    // full ; flush without waiting
+    if (r.sq_local_tail - load_acquire(r.sq_head) >= r.sq_entries) {
+        store_release(r.sq_tail, r.sq_local_tail);
+        sys_enter(r.fd, r.queued, 0, 0);
+        r.queued = 0;
+    }
+    const unsigned idx = r.sq_local_tail & r.sq_mask;
+    io_uring_sqe* sqe = &r.sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    r.sq_array[idx] = idx;
+    r.sq_local_tail++;
+    r.queued++;
+    return sqe;
+}
+
+static char* buf_at(const Ring& r, const uint16_t bid) {
+    return r.buf_mem + static_cast<size_t>(bid) * RECV_BUF_SIZE;
+}
+
+static void ring_put(Ring& r, const uint16_t bid) {
+    auto& b = r.bufs->bufs[r.buf_tail & (RECV_BUFS - 1)];
+    b.addr = reinterpret_cast<uint64_t>(buf_at(r, bid));
+    b.len = RECV_BUF_SIZE;
+    b.bid = bid;
+    r.buf_tail++;
+}
+
+// legacy provided buffers ; one sqe hands back n buffers starting at bid
+static void provide(Ring& r, const uint16_t bid, const unsigned n) {
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = static_cast<int>(n);
+    sqe->addr = reinterpret_cast<uint64_t>(buf_at(r, bid));
+    sqe->len = RECV_BUF_SIZE;
+    sqe->off = bid;
+    sqe->buf_group = RECV_GROUP;
+    sqe->user_data = PROVIDE_TAG;
+}
+
+// the kernel picks a buffer per recv completion ; we hand it back once parsed
+static void recycle(Ring& r, const uint16_t bid) {
+    if (r.buf_ring) {
+        ring_put(r, bid);
+        store_release(&r.bufs->tail, static_cast<uint16_t>(r.buf_tail));
+    }
+    else provide(r, bid, 1);
+}
+
+// some kernels register a buffer ring and then never take from it ; one recv tells
+static bool buf_ring_works(Ring& r) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return false;
+    const char probe = 'p';
+    const bool sent = write(sv[1], &probe, 1) == 1;
+
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = sv[0];
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_GROUP;
+    sqe->user_data = PROBE_TAG;
+    submit_and_wait(r);
+
+    const io_uring_cqe cqe = take_cqe(r);
+    close(sv[0]);
+    close(sv[1]);
+
+    if (!sent || cqe.res != 1) return false;
+    recycle(r, static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+    return true;
+}
+
+static void setup_buffers(Ring& r) {
+    const size_t ring_bytes = RECV_BUFS * sizeof(io_uring_buf);
+    r.bufs = static_cast<io_uring_buf_ring*>(mmap(nullptr, ring_bytes, PROT_READ | PROT_WRITE,
+                                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    if (r.bufs != MAP_FAILED) {
+        for (unsigned bid = 0; bid < RECV_BUFS; bid++) ring_put(r, static_cast<uint16_t>(bid));
+        store_release(&r.bufs->tail, static_cast<uint16_t>(r.buf_tail));
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>(r.bufs);
+        reg.ring_entries = RECV_BUFS;
+        reg.bgid = RECV_GROUP;
+        r.buf_ring = sys_register(r.fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+
+        if (r.buf_ring && !buf_ring_works(r)) {
+            sys_register(r.fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            r.buf_ring = false;
+        }
+    }
+    if (r.buf_ring) return;
+
+    // fall back to the pre-5.19 interface ; same group id, recycled one sqe per buffer
+    provide(r, 0, RECV_BUFS);
+}
+
+static void arm_accept(Ring& r, const int listen_fd) {
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = ACCEPT_TAG;
+}
+
+// a Conn plus the reply bytes the kernel is sending ; out keeps filling meanwhile
+struct UConn : Conn {
+    std::string sending;
+    bool recv_armed{true};
+    bool send_armed{false};
+    bool closing{false};
+    bool cancelling{false}; // the stalled recv's cancel hasn't completed
+    std::string held;       // read while stalled ; parsed a buffer at a time once out drains
+    bool queued{false};     // on this pass's flush list
+};
+
+static void arm_recv(Ring& r, UConn* c) {
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = c->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = RECV_GROUP;
+    sqe->user_data = reinterpret_cast<uint64_t>(c);
+}
+
+// stops a stalled client's multishot recv ; it ends with -ECANCELED
+static void cancel_recv(Ring& r, UConn* c) {
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->addr = reinterpret_cast<uint64_t>(c);
+    sqe->user_data = reinterpret_cast<uint64_t>(c) | CANCEL_BIT;
+    c->cancelling = true;
+}
+
+static void arm_send(Ring& r, UConn* c) {
+    io_uring_sqe* sqe = next_sqe(r);
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = c->fd;
+    sqe->addr = reinterpret_cast<uint64_t>(c->sending.data());
+    sqe->len = static_cast<uint32_t>(c->sending.size());
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = reinterpret_cast<uint64_t>(c) | SEND_BIT;
+    c->send_armed = true;
+}
+
+// a stalled client's replies are all out ; parse what it sent meanwhile until out fills up
+// again, and read from it once that's all gone
+static void resume(Ring& r, UConn* c, const Handler on_data) {
+    size_t pos = 0;
+    while (pos < c->held.size() && c->out.size() < OUT_HIGH && !c->hangup) {
+        const size_t n = std::min<size_t>(c->held.size() - pos, RECV_BUF_SIZE);
+        c->in.append(c->held, pos, n);
+        pos += n;
+        on_data(*c);
+    }
+    c->held.erase(0, pos);
+
+    // its recv is down already ; send what's left, then close
+    if (c->hangup) {
+        c->held.clear();
+        c->closing = true;
+        return;
+    }
+    if (!c->held.empty() || c->out.size() >= OUT_HIGH) return;
+    c->stalled = false;
+    c->recv_armed = true;
+    arm_recv(r, c);
+}
+
+// end of a pass : one send per connection for everything its reads produced
+static void settle(Ring& r, UConn* c, const Handler on_data) {
+    if (c->stalled && !c->closing && !c->recv_armed && !c->cancelling && !c->send_armed && c->out.empty()) {
+        resume(r, c, on_data);
+    }
+    if (!c->send_armed && !c->out.empty()) {
+        std::swap(c->out, c->sending);
+        arm_send(r, c);
+    }
+    if (c->closing && !c->recv_armed && !c->send_armed && !c->cancelling) {
+        close(c->fd);
+        delete c;
+    }
+}
+
+// settled once at the end of the pass ; c may have more cqes in this one
+static void mark(UConn* c, vector<UConn*>& dirty) {
+    if (c->queued) return;
+    c->queued = true;
+    dirty.push_back(c);
+}
+
+// a multishot recv that ended on its own ; left down while c is stalled
+static void rearm_recv(Ring& r, UConn* c) {
+    if (c->stalled) c->recv_armed = false;
+    else arm_recv(r, c);
+}
+
+static void on_recv(Ring& r, UConn* c, const io_uring_cqe& cqe, const Handler on_data, vector<UConn*>& dirty) {
+    const bool more = cqe.flags & IORING_CQE_F_MORE;
+
+    if (cqe.res > 0) {
+        const auto bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+
+        // handler gave up on c ; drop what was already in flight
+        if (c->stalled && !c->hangup) c->held.append(buf_at(r, bid), cqe.res);
+        else if (!c->hangup) {
+            c->in.append(buf_at(r, bid), cqe.res);
+            on_data(*c);
+
+            // the recv ends at eof ; what's in out still goes before the close
+            if (c->hangup) shutdown(c->fd, SHUT_RD);
+        }
+        recycle(r, bid);
+
+        // not reading its replies ; stop reading its requests until settle() sees them out
+        if (!c->stalled && c->out.size() + c->sending.size() >= OUT_HIGH) {
+            c->stalled = true;
+            if (more) cancel_recv(r, c);
+        }
+        if (!more) rearm_recv(r, c);
+    }
+
+    // out of buffers ; they come back as this pass is parsed
+    else if (cqe.res == -ENOBUFS) {
+        if (!more) rearm_recv(r, c);
+    }
+
+    // cancelled while stalled ; settle() re-arms it
+    else if (cqe.res == -ECANCELED && c->stalled) {
+        c->recv_armed = false;
+    }
+
+    // eof or error ; send what's left, then close
+    else if (!more) {
+        c->recv_armed = false;
+        c->closing = true;
+    }
+
+    mark(c, dirty);
+}
+
+static void on_send(Ring& r, UConn* c, const io_uring_cqe& cqe, vector<UConn*>& dirty) {
+    c->send_armed = false;
+
+    if (cqe.res > 0 && static_cast<size_t>(cqe.res) < c->sending.size()) {
+        c->sending.erase(0, cqe.res);
+        arm_send(r, c);
+        return;
+    }
+    c->sending.clear();
+
+    // peer is gone ; ending the recv side gets c closed
+    if (cqe.res <= 0) {
+        c->out.clear();
+        shutdown(c->fd, SHUT_RDWR);
+    }
+    mark(c, dirty);
+}
+
+// the accept4 errors epoll's accept_all shrugs off too ; anything else won't get better
+static bool accept_retryable(const int err) {
+    return err == ECONNABORTED || err == EINTR || err == EAGAIN || err == EMFILE || err == ENFILE
+        || err == ENOBUFS || err == ENOMEM || err == EPERM || err == EPROTO;
+}
+
+[[noreturn]] static void loop(const int listen_fd, const Handler on_data) {
+    get_my_hp_index();
+
+    // out of rings, or locked memory ; this loop serves with epoll, the others carry on
+    Ring r;
+    if (!setup(r)) run_epoll_loops(listen_fd, 1, on_data);
+    setup_buffers(r);
+    arm_accept(r, listen_fd);
+    vector<UConn*> dirty;
+
+    while (true) {
+        submit_and_wait(r);
+
+        unsigned head = *r.cq_head;
+        const unsigned tail = load_acquire(r.cq_tail);
+        for (; head != tail; head++) {
+            const io_uring_cqe cqe = r.cqes[head & r.cq_mask];
+
+            if (cqe.user_data == PROVIDE_TAG) continue;
+
+            if (cqe.user_data == ACCEPT_TAG) {
+                if (cqe.res >= 0) {
+                    const int one = 1;
+                    setsockopt(cqe.res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    auto* c = new UConn;
+                    c->fd = cqe.res;
+                    arm_recv(r, c);
+                }
+                else if (!accept_retryable(-cqe.res)) {
+                    errno = -cqe.res;
+                    perror("io_uring accept");
+                    _exit(1);
+                }
+                if (!(cqe.flags & IORING_CQE_F_MORE)) arm_accept(r, listen_fd);
+                continue;
+            }
+
+            auto* c = reinterpret_cast<UConn*>(cqe.user_data & ~(SEND_BIT | CANCEL_BIT));
+            if (cqe.user_data & SEND_BIT) on_send(r, c, cqe, dirty);
+            else if (cqe.user_data & CANCEL_BIT) {
+                c->cancelling = false;
+                mark(c, dirty);
+            }
+            else on_recv(r, c, cqe, on_data, dirty);
+        }
+        store_release(r.cq_head, head);
+
+        for (UConn* c : dirty) {
+            c->queued = false;
+            settle(r, c, on_data);
+        }
+        dirty.clear();
+    }
+}
+
+static void teardown(Ring& r) {
+    if (r.bufs != MAP_FAILED && r.bufs != nullptr) munmap(r.bufs, RECV_BUFS * sizeof(io_uring_buf));
+    munmap(r.sqes, r.sqe_bytes);
+    munmap(r.ring_mem, r.ring_bytes);
+    close(r.fd);
+    delete[] r.buf_mem;
+}
+
+// every opcode the loops submit
+static bool ops_supported(const Ring& r) {
+    constexpr unsigned N = 256;
+    vector<char> mem(sizeof(io_uring_probe) + N * sizeof(io_uring_probe_op));
+    auto* probe = reinterpret_cast<io_uring_probe*>(mem.data());
+    if (sys_register(r.fd, IORING_REGISTER_PROBE, probe, N) < 0) return false;
+
+    for (const int op : {IORING_OP_ACCEPT, IORING_OP_RECV, IORING_OP_SEND, IORING_OP_PROVIDE_BUFFERS, IORING_OP_ASYNC_CANCEL}) {
+        if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) return false;
+    }
+    return true;
+}
+
+// the opcodes can be there without their multishot flags (before 6.0), which only shows as
+// -EINVAL completions ; one multishot accept and recv over loopback tells
+static bool multishot_works(Ring& r) {
+    const int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    const int cfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    bool ok = lfd >= 0 && cfd >= 0
+        && bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0
+        && listen(lfd, 1) == 0
+        && getsockname(lfd, reinterpret_cast<sockaddr*>(&addr), &len) == 0;
+
+    int afd = -1;
+    if (ok) {
+        arm_accept(r, lfd);
+        ok = connect(cfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    }
+    if (ok) {
+        const io_uring_cqe cqe = take_cqe(r);
+        afd = cqe.res;
+        ok = cqe.res >= 0 && (cqe.flags & IORING_CQE_F_MORE);
+    }
+    if (ok) {
+        const char b = 'p';
+        UConn probe;
+        probe.fd = afd;
+        arm_recv(r, &probe);
+        ok = write(cfd, &b, 1) == 1;
+        if (ok) {
+            const io_uring_cqe cqe = take_cqe(r);
+            ok = cqe.res == 1 && (cqe.flags & IORING_CQE_F_MORE);
+        }
+    }
+
+    if (afd >= 0) close(afd);
+    if (cfd >= 0) close(cfd);
+    if (lfd >= 0) close(lfd);
+    return ok;
+}
+
+bool uring_supported() {
+    Ring r;
+    if (!setup(r)) return false;
+    setup_buffers(r);
+    const bool ok = ops_supported(r) && multishot_works(r);
+    teardown(r);
+    return ok;
+}
+
+void run_uring_loops(const int listen_fd, const int threads, const Handler on_data) {
+    for (int i = 1; i < threads; i++) std::thread(loop, listen_fd, on_data).detach();
+    loop(listen_fd, on_data);
+}
@@ -2,107 +2,413 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string>
+#include <string_view>
+#include <charconv>
 #include <thread>
-#include <unistd.h>
 #include <chrono>
 #include <atomic>
 #include <vector>
-
-enum HP_Index {
-    K = 0,
-    V = 1
-};
-
-struct HP_Slot {
-    std::atomic<void*> slot[2]{ nullptr, nullptr };
-    std::atomic<bool> in_use{ false };
-};
-
-extern std::vector<HP_Slot> hp;
-extern thread_local int my_hp_index;
-extern thread_local std::vector<std::string*> retired_list;
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <cctype>
+#include "reclaim.h"
+#include "ops.h"
+#include "loop.h"
+#include "frame.h"
+#include "shard.h"
+#include "snapshot.h"
+#include "aof.h"
+#include "ttl.h"
+#include "http.h"
+#include "trace.h"
 
 extern void inc_set_count();
 
-extern int get_my_hp_index();
-extern void get(const std::string& key);
-extern void set(const std::string& key, const std::string& value);
-extern void del(const std::string& key);
-
 extern void start(int expected, int admin_socket);
 extern void inc_active();
 extern void dec_active_log_lat(double latency_ms);
+extern std::string get_stats(const std::vector<std::atomic<Table*>*>& roots, bool prometheus);
+
+// the parser never copies : every token is a view into the connection's read buffer,
+// valid until on_data() drops the consumed prefix
+
+// next space separated word from pos ; empty once the line runs out
+std::string_view next_word(const std::string_view line, size_t& pos) {
+    while (pos < line.size() && line[pos] == ' ') pos++;
+    const size_t sp = line.find(' ', pos);
+    const size_t end = sp == std::string_view::npos ? line.size() : sp;
+    const std::string_view w = line.substr(pos, end - pos);
+    pos = end;
+    return w;
+}
+
+// everything after the next separator, spaces included
+std::string_view rest(const std::string_view line, const size_t pos) {
+    return pos < line.size() ? line.substr(pos + 1) : std::string_view{};
+}
 
-void Hreq(const std::string& input) {
-    const size_t sp0 = input.find(' ');
-    const std::string cmd = input.substr(0, sp0);
+// a value may hold spaces, so SET's EX option is only looked for at the very end
+// 1 took " EX <seconds>" off value | 0 none there | -1 bad seconds
+int take_ex(std::string_view& value, uint32_t& ex) {
+    const size_t at = value.rfind(" EX ");
+    if (at == std::string_view::npos) return 0;
+    const std::string_view n = value.substr(at + 4);
+    const auto [end, ec] = std::from_chars(n.data(), n.data() + n.size(), ex);
+    if (n.empty() || end != n.data() + n.size()) return 0;
+    value = value.substr(0, at);
+    return ec == std::errc{} && ex > 0 ? 1 : -1;
+}
+
+std::vector<std::string_view> words(const std::string_view line, size_t pos) {
+    std::vector<std::string_view> out;
+    for (std::string_view w = next_word(line, pos); !w.empty(); w = next_word(line, pos)) out.push_back(w);
+    return out;
+}
+
+// replies, one per request, appended to the connection's out buffer
+//   +OK\n                      SET [EX seconds] DEL MSET MDEL TRACE
+//   $<len>\n<bytes>\n          GET hit, STATS
+//   $-1\n                      GET miss
+//   *<n>\n then n of the above  MGET
+//   -ERR <why>\n
+void put_bulk(std::string& out, const bool hit, const std::string& value) {
+    if (!hit) {
+        out += "$-1\n";
+        return;
+    }
+    out += '$';
+    out += std::to_string(value.size());
+    out += '\n';
+    out += value;
+    out += '\n';
+}
+
+// where SAVE writes ; set from the command line only, never by a client
+std::string snapshot_path = "zoom.snap";
+std::string trace_path = "zoom-trace.json";    // where TRACE DUMP writes ; likewise
+
+void Hreq(const std::string_view line, std::string& out) {
+    size_t pos = 0;
+    const std::string_view cmd = next_word(line, pos);
 
     if (cmd == "GET") {
-        const std::string key = input.substr(sp0 + 1);
-        get(key);
+        const std::string_view key = rest(line, pos);
+        thread_local std::string value;
+        const bool hit = kv_get(key, value);
+        put_bulk(out, hit, value);
     }
     else if (cmd == "SET") {
-        const size_t sp1 = input.find(' ', sp0+1);
-        const std::string key = input.substr(sp0+1, sp1-sp0-1);
-        const std::string value = input.substr(sp1+1);
+        const std::string_view key = next_word(line, pos);
+        std::string_view value = rest(line, pos);
+        uint32_t ex;
+        const int has_ex = take_ex(value, ex);
+        if (has_ex < 0) {
+            out += "-ERR invalid expire time\n";
+            return;
+        }
+        const uint32_t exp = has_ex ? ttl_deadline(ex) : TTL_NEVER;
         inc_set_count();
-        set(key, value);
+        kv_set(key, value, exp);
+        out += "+OK\n";
     }
     else if (cmd == "DEL") {
-        const std::string key = input.substr(sp0 + 1);
-        del(key);
+        const std::string_view key = rest(line, pos);
+        kv_del(key);
+        out += "+OK\n";
+    }
+    else if (cmd == "MGET") {
+        const auto keys = words(line, pos);
+        thread_local std::vector<std::string> values;
+        thread_local std::vector<uint8_t> found;
+        kv_mget(keys, values, found);
+        out += '*';
+        out += std::to_string(keys.size());
+        out += '\n';
+        for (size_t i = 0; i < keys.size(); i++) put_bulk(out, found[i], values[i]);
+    }
+    else if (cmd == "MSET") {
+        // k1 v1 k2 v2 ... ; a key without its value fails the whole command
+        const auto kv = words(line, pos);
+        if (kv.empty() || kv.size() % 2 != 0) {
+            out += "-ERR wrong number of arguments\n";
+            return;
+        }
+        std::vector<std::string_view> keys, values;
+        for (size_t i = 0; i < kv.size(); i += 2) {
+            keys.push_back(kv[i]);
+            values.push_back(kv[i + 1]);
+            inc_set_count();
+        }
+        kv_mset(keys, values);
+        out += "+OK\n";
+    }
+    else if (cmd == "MDEL") {
+        const auto keys = words(line, pos);
+        kv_mdel(keys);
+        out += "+OK\n";
+    }
+    else if (cmd == "SAVE") {
+        // to --snapshot's path ; written in the background, the reply doesn't wait for it
+        if (!rest(line, pos).empty()) out += "-ERR SAVE takes no arguments\n";
+        else if (snapshot_begin(kv_roots(), snapshot_path)) out += "+OK\n";
+        else out += "-ERR snapshot in progress\n";
+    }
+    else if (cmd == "STATS") {
+        // "name{labels} value" lines, the same readings /metrics serves
+        put_bulk(out, true, get_stats(kv_roots(), false));
+    }
+    else if (cmd == "TRACE") {
+        // TRACE ON | OFF | DUMP ; the dump is Chrome trace JSON to --trace-out's path,
+        // written in the background like SAVE
+        const std::string_view what = next_word(line, pos);
+        if (!rest(line, pos).empty()) out += "-ERR TRACE ON, OFF or DUMP\n";
+        else if (what == "ON" || what == "OFF") {
+            trace_enable(what == "ON");
+            out += "+OK\n";
+        }
+        else if (what == "DUMP") {
+            if (trace_dump_begin(trace_path)) out += "+OK\n";
+            else out += "-ERR trace dump in progress\n";
+        }
+        else out += "-ERR TRACE ON, OFF or DUMP\n";
+    }
+    else if (cmd == "REWRITE") {
+        if (aof_rewrite_begin()) out += "+OK\n";
+        else out += "-ERR no log, or a rewrite is running\n";
+    }
+    else {
+        out += "-ERR unknown command\n";
     }
 }
 
-[[noreturn]] int main() {
+constexpr uint8_t PROTO_TEXT = 0;
+constexpr uint8_t PROTO_BINARY = 1;
+
+// a run of same-op frames in one batch call ; replies go out in frame order
+void run_frames(const std::vector<Frame>& run, std::string& out) {
+    thread_local std::vector<std::string_view> keys, vals;
+    thread_local std::vector<std::string> got;
+    thread_local std::vector<uint8_t> found;
+    keys.clear();
+    vals.clear();
+    for (const Frame& f : run) {
+        keys.push_back(f.key);
+        vals.push_back(f.val);
+    }
+
+    switch (run[0].op) {
+        case OP_GET:
+            kv_mget(keys, got, found);
+            for (size_t i = 0; i < run.size(); i++) {
+                if (found[i]) put_frame(out, run[i].id, ST_OK, {}, got[i]);
+                else put_frame(out, run[i].id, ST_MISS, {}, {});
+            }
+            break;
+        case OP_SET:
+            for (size_t i = 0; i < run.size(); i++) inc_set_count();
+            kv_mset(keys, vals);
+            for (const Frame& f : run) put_frame(out, f.id, ST_OK, {}, {});
+            break;
+        case OP_DEL:
+            kv_mdel(keys);
+            for (const Frame& f : run) put_frame(out, f.id, ST_OK, {}, {});
+            break;
+        default:
+            for (const Frame& f : run) put_frame(out, f.id, ST_ERR, {}, "unknown op");
+    }
+}
+
+// a batch's latency is shared evenly by its frames
+void timed_run(const std::vector<Frame>& run, std::string& out) {
+    for (size_t i = 0; i < run.size(); i++) inc_active();
+    auto t1 = std::chrono::high_resolution_clock::now();
+    run_frames(run, out);
+    auto t2 = std::chrono::high_resolution_clock::now();
+    const double lat = std::chrono::duration<double>(t2 - t1).count() * 1000.0 / run.size();
+    for (size_t i = 0; i < run.size(); i++) dec_active_log_lat(lat);
+}
+
+// every whole frame in c.in ; back to back frames with the same op batch together
+void on_frames(Conn& c) {
+    const std::string_view in = c.in;
+    thread_local std::vector<Frame> run;
+    size_t pos = 0, used;
+    Frame f;
+    int got;
+    while ((got = read_frame(in.substr(pos), f, used)) > 0) {
+        pos += used;
+        if (!run.empty() && run.back().op != f.op) {
+            timed_run(run, c.out);
+            run.clear();
+        }
+        run.push_back(f);
+    }
+    if (!run.empty()) {
+        timed_run(run, c.out);
+        run.clear();
+    }
+
+    // not worth waiting for ; the rest of the stream can't be trusted either
+    if (got < 0) {
+        put_frame(c.out, f.id, ST_ERR, {}, "frame too large");
+        c.hangup = true;
+        c.in.clear();
+        return;
+    }
+    c.in.erase(0, pos);
+}
+
+// every complete line in c.in ; a partial last line waits for more bytes
+void on_lines(Conn& c) {
+    const std::string_view in = c.in;
+    size_t pos = 0, i;
+    while ((i = in.find('\n', pos)) != std::string_view::npos) {
+        const std::string_view line = in.substr(pos, i - pos);
+        pos = i + 1;
+
+        if (line.starts_with("START")) {
+            int exp = 0;
+            const std::string_view n = rest(line, line.find(' '));
+            std::from_chars(n.data(), n.data() + n.size(), exp);
+            start(exp, c.fd);
+            continue;
+        }
+
+        // frames from here on ; they may already be in the buffer
+        if (line == "BINARY") {
+            c.out += "+OK\n";
+            c.proto = PROTO_BINARY;
+            c.in.erase(0, pos);
+            on_frames(c);
+            return;
+        }
+
+        inc_active();
+        auto t1 = std::chrono::high_resolution_clock::now();
+        Hreq(line, c.out);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        const double lat = std::chrono::duration<double>(t2 - t1).count() * 1000.0;
+        dec_active_log_lat(lat);
+    }
+    c.in.erase(0, pos);
+}
+
+// replies pile up in c.out and the loop sends them once per read batch
+// under AOF_BATCH they wait here until the batch's writes are on disk
+void on_data(Conn& c) {
+    if (c.proto == PROTO_BINARY) on_frames(c);
+    else on_lines(c);
+    aof_commit();
+}
+
+// 512, 64k, 100m, 2g
+size_t parse_bytes(const std::string_view s) {
+    size_t n = 0;
+    const auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (ec != std::errc{}) throw std::invalid_argument("bad size: " + std::string(s));
+    const std::string_view unit = s.substr(end - s.data());
+    if (unit == "k") return n << 10;
+    if (unit == "m") return n << 20;
+    if (unit == "g") return n << 30;
+    if (unit.empty()) return n;
+    throw std::invalid_argument("bad size: " + std::string(s));
+}
+
+std::string prometheus_stats() {
+    return get_stats(kv_roots(), true);
+}
+
+// server [threads] [--shards] [--load path] [--snapshot path] [--aof path] [--fsync none|batch|<ms>]
+//        [--maxmemory size] [--metrics-port port] [--trace] [--trace-out path]
+// --snapshot is where SAVE writes, zoom.snap by default ; --trace-out where TRACE DUMP does, zoom-trace.json
+// threads defaults to one per core, --fsync to 1000 ms ; --maxmemory makes it a cache that evicts
+// --metrics-port serves GET /metrics in the Prometheus text format ; --trace starts with TRACE ON
+// an unknown flag, a flag missing its value or a bad number
+static int usage(const char* bad) {
+    std::cerr << "bad argument " << bad << "\n"
+              << "usage: server [threads] [--shards] [--load path] [--snapshot path] [--aof path] [--fsync none|batch|<ms>]\n"
+              << "              [--maxmemory size] [--metrics-port port] [--trace] [--trace-out path]" << std::endl;
+    return 1;
+}
+
+int main(const int argc, char** argv) {
+    const int cores = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    int loops = cores;
+    bool sharded = false;
+    std::string load_path, aof_path;
+    AofSync sync = AOF_INTERVAL;
+    int sync_ms = 1000;
+    int metrics_port = 0;
+    for (int i = 1; i < argc; i++) {
+        try {
+            if (std::string_view(argv[i]) == "--shards") sharded = true;
+            else if (std::string_view(argv[i]) == "--load" && i + 1 < argc) load_path = argv[++i];
+            else if (std::string_view(argv[i]) == "--snapshot" && i + 1 < argc) snapshot_path = argv[++i];
+            else if (std::string_view(argv[i]) == "--aof" && i + 1 < argc) aof_path = argv[++i];
+            else if (std::string_view(argv[i]) == "--maxmemory" && i + 1 < argc) mem_budget = parse_bytes(argv[++i]);
+            else if (std::string_view(argv[i]) == "--metrics-port" && i + 1 < argc) metrics_port = std::stoi(argv[++i]);
+            else if (std::string_view(argv[i]) == "--trace") trace_enable(true);
+            else if (std::string_view(argv[i]) == "--trace-out" && i + 1 < argc) trace_path = argv[++i];
+            else if (std::string_view(argv[i]) == "--fsync" && i + 1 < argc) {
+                const std::string_view p = argv[++i];
+                if (p == "none") sync = AOF_NONE;
+                else if (p == "batch") sync = AOF_BATCH;
+                else sync_ms = std::stoi(argv[i]);
+            }
+            else if (std::isdigit(static_cast<unsigned char>(argv[i][0]))) {
+                size_t used;
+                loops = std::max(1, std::stoi(argv[i], &used));
+                if (argv[i][used] != '\0') return usage(argv[i]);
+            }
+            else return usage(argv[i]);
+        }
+        catch (const std::exception&) {
+            return usage(argv[i]);
+        }
+    }
+#ifdef ZOOM_INSTRUMENT
+    ns_per_tick();   // calibrate now rather than under the first timed op
+#endif
+    if (sharded) make_shards(loops);
+    ttl_start();
+
+    if (!load_path.empty()) {
+        const auto t1 = std::chrono::high_resolution_clock::now();
+        const size_t keys = snapshot_load(load_path, kv_roots(), kv_owner, cores);
+        const auto t2 = std::chrono::high_resolution_clock::now();
+        std::cout << "loaded " << keys << " keys from " << load_path << " in "
+                  << std::chrono::duration<double>(t2 - t1).count() << "s" << std::endl;
+    }
+
+    // snapshot first, then the writes logged since
+    if (!aof_path.empty()) {
+        try {
+            const size_t records = aof_open(aof_path, sync, sync_ms, kv_roots(), kv_owner);
+            std::cout << "replayed " << records << " records from " << aof_path << std::endl;
+        }
+        catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    if (metrics_port > 0) serve_metrics(metrics_port, prometheus_stats);
+
+    if (sharded) run_shards(8080, on_data);
+
     const int server_socket = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(server_socket, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
     sockaddr_in address{};
     address.sin_family = AF_INET;
     address.sin_port = htons(8080);
     address.sin_addr.s_addr = INADDR_ANY;
-    bind(server_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address));
-    listen(server_socket, 10);
-
-    while (true) {
-        int client_socket = accept(server_socket, nullptr, nullptr);
-
-        std::thread([client_socket]() {
-            get_my_hp_index();
-            std::string data;
-            char batch[1024];
-            ssize_t bytes_read;
-            size_t i;
-
-            while ((bytes_read = read(client_socket, batch, 1024)) > 0) {
-                data.append(batch, bytes_read);
-
-                while ((i = data.find('\n')) != std::string::npos) {
-                    std::string cmd = data.substr(0, i);
-                    data.erase(0, i + 1);
-
-                    if (cmd.substr(0, 5) == "START") {
-                        const size_t sp = cmd.find(' ');
-                        const int exp = std::stoi(cmd.substr(sp + 1));
-                        start(exp, client_socket);
-                        continue;
-                    }
-
-                    inc_active();
-                    auto t1 = std::chrono::high_resolution_clock::now();
-                    Hreq(cmd);
-                    auto t2 = std::chrono::high_resolution_clock::now();
-                    const double lat = std::chrono::duration<double>(t2 - t1).count() * 1000.0;
-                    dec_active_log_lat(lat);
-                }
-            }
-
-            hp[my_hp_index].slot[K].store(nullptr);
-            hp[my_hp_index].slot[V].store(nullptr);
-            for (auto* ptr : retired_list) delete ptr;
-            retired_list.clear();
-            hp[my_hp_index].in_use.store(false);
-
-            close(client_socket);
-        }).detach();
+    if (bind(server_socket, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+        perror("bind");
+        return 1;
     }
-}
\ No newline at end of file
+    listen(server_socket, SOMAXCONN);
+
+    run_loops(server_socket, loops, on_data);
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include "loop.h"
+#include "types.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// shard per core : n loop threads, each pinned to a core with its own SO_REUSEPORT
+// listener and its own table. a key belongs to one shard ; an op on someone else's
+// key is posted to the owner over an SPSC queue and runs on the owner's thread
+void make_shards(int n);
+[[noreturn]] void run_shards(int port, Handler on_data);
+
+// every table root, one per shard or just tb ; kv_owner(h) indexes it
+std::vector<atomic<Table*>*> kv_roots();
+int kv_owner(uint64_t h);
+
+// the ops as the server should call them ; straight to the shared table when not sharded
+bool kv_get(std::string_view k, std::string& out);
+void kv_set(std::string_view k, std::string_view v);
+void kv_set(std::string_view k, std::string_view v, uint32_t exp);
+void kv_del(std::string_view k);
+size_t kv_mget(const std::vector<std::string_view>& keys, std::vector<std::string>& vals, std::vector<uint8_t>& found);
+void kv_mset(const std::vector<std::string_view>& keys, const std::vector<std::string_view>& vals);
+void kv_mdel(const std::vector<std::string_view>& keys);
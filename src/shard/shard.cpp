@@ -0,0 +1,277 @@
+#include "include/shard.h"
+#include "ops.h"
+#include "hash.h"
+#include "spsc.h"
+#include "backoff.h"
+#include "reclaim.h"
+#include "aof.h"
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+constexpr size_t FWD_RING = 64;     // a poster waits on what it posts, so few are ever queued
+
+// an op posted to another shard ; the poster waits on done
+struct Fwd {
+    void (*run)(Fwd*){nullptr};
+    atomic<bool> done{false};
+};
+
+// fn(s) on shard s's thread
+template<typename F>
+struct Job : Fwd {
+    F* fn{nullptr};
+    int s{0};
+
+    static void call(Fwd* self) {
+        auto* j = static_cast<Job*>(self);
+        (*j->fn)(j->s);
+    }
+};
+
+struct alignas(64) Shard {
+    atomic<Table*> root;
+    int wake_fd{-1};
+    atomic<bool> wake_pending{false};
+    std::unique_ptr<Spsc<Fwd*, FWD_RING>[]> inbox;     // one per posting shard
+
+    Shard() : root(new Table(INIT_CAPACITY, &root)) {}
+};
+
+static vector<Shard*> shards;       // empty unless sharded
+static thread_local int my_shard = -1;
+
+// the step takes h >> 32 too, but only its low bits matter to a power-of-two table
+static int shard_of(const uint64_t h) {
+    return static_cast<int>(((h >> 32) * shards.size()) >> 32);
+}
+
+// what other shards posted here ; all of it is local, so none of it posts again
+static void serve() {
+    Shard& me = *shards[my_shard];
+    Fwd* f;
+    for (size_t from = 0; from < shards.size(); from++) {
+        while (me.inbox[from].pop(f)) {
+            f->run(f);
+            f->done.store(true, release);
+        }
+    }
+}
+
+// the exchange pairs with post()'s ; anything posted before it is visible to serve()
+static void on_wake() {
+    shards[my_shard]->wake_pending.exchange(false, seq_cst);
+    serve();
+}
+
+static void post(const int to, Fwd& f) {
+    Shard& dst = *shards[to];
+    while (!dst.inbox[my_shard].push(&f)) serve();
+    if (!dst.wake_pending.exchange(true, seq_cst)) {
+        const uint64_t one = 1;
+        write(dst.wake_fd, &one, sizeof(one));
+    }
+}
+
+// keep serving while we wait ; two shards posting to each other both get through
+// yields once the backoff is spent, the owner may be sharing our core
+static void wait(const Fwd& f) {
+    Backoff backoff;
+    while (!f.done.load(acquire)) {
+        serve();
+        if (!backoff.spent()) backoff();
+        else std::this_thread::yield();
+    }
+}
+
+template<typename F>
+static void run_at(const int s, F& fn) {
+    if (s == my_shard) return fn(s);
+    Job<F> j;
+    j.run = &Job<F>::call;
+    j.fn = &fn;
+    j.s = s;
+    post(s, j);
+    wait(j);
+}
+
+// a batch cut up by owner
+struct Part {
+    vector<uint32_t> idx;       // positions in the caller's batch
+    vector<std::string_view> keys;
+    vector<std::string_view> vals;
+    vector<string> got;
+    vector<uint8_t> found;
+};
+
+// the owner's batch op hashes each key again ; cheaper than shipping the hashes
+static vector<Part>& split(const vector<std::string_view>& keys, const vector<std::string_view>* vals) {
+    thread_local vector<Part> parts;
+    parts.resize(shards.size());
+    for (Part& p : parts) {
+        p.idx.clear();
+        p.keys.clear();
+        p.vals.clear();
+    }
+    for (uint32_t i = 0; i < keys.size(); i++) {
+        Part& p = parts[shard_of(hash(keys[i]))];
+        p.idx.push_back(i);
+        p.keys.push_back(keys[i]);
+        if (vals) p.vals.push_back((*vals)[i]);
+    }
+    return parts;
+}
+
+// fn(s) for every shard with a part, all in flight at once ; ours runs here meanwhile
+template<typename F>
+static void run_parts(const vector<Part>& parts, F& fn) {
+    const int n = static_cast<int>(shards.size());
+    std::unique_ptr<Job<F>[]> jobs(new Job<F>[n]);
+
+    for (int s = 0; s < n; s++) {
+        if (s == my_shard || parts[s].keys.empty()) continue;
+        jobs[s].run = &Job<F>::call;
+        jobs[s].fn = &fn;
+        jobs[s].s = s;
+        post(s, jobs[s]);
+    }
+    if (!parts[my_shard].keys.empty()) fn(my_shard);
+    for (int s = 0; s < n; s++) {
+        if (jobs[s].run != nullptr) wait(jobs[s]);
+    }
+}
+
+bool kv_get(const std::string_view k, string& out) {
+    if (shards.empty()) return get(k, out);
+    bool hit = false;
+    auto fn = [&](int) { hit = get(k, out); };
+    run_at(shard_of(hash(k)), fn);
+    return hit;
+}
+
+void kv_set(const std::string_view k, const std::string_view v) {
+    if (shards.empty()) return set(k, v);
+    auto fn = [&](int) { set(k, v); };
+    run_at(shard_of(hash(k)), fn);
+    aof_wrote_elsewhere();
+}
+
+void kv_set(const std::string_view k, const std::string_view v, const uint32_t exp) {
+    if (shards.empty()) return set(k, v, exp);
+    auto fn = [&](int) { set(k, v, exp); };
+    run_at(shard_of(hash(k)), fn);
+    aof_wrote_elsewhere();
+}
+
+void kv_del(const std::string_view k) {
+    if (shards.empty()) return del(k);
+    auto fn = [&](int) { del(k); };
+    run_at(shard_of(hash(k)), fn);
+    aof_wrote_elsewhere();
+}
+
+size_t kv_mget(const vector<std::string_view>& keys, vector<string>& vals, vector<uint8_t>& found) {
+    if (shards.empty()) return mget(keys, vals, found);
+
+    vector<Part>& parts = split(keys, nullptr);
+    auto fn = [&](const int s) { mget(parts[s].keys, parts[s].got, parts[s].found); };
+    run_parts(parts, fn);
+
+    vals.resize(keys.size());
+    found.assign(keys.size(), 0);
+    size_t hits = 0;
+    for (Part& p : parts) {
+        for (size_t j = 0; j < p.idx.size(); j++) {
+            if (!p.found[j]) continue;
+            vals[p.idx[j]].swap(p.got[j]);
+            found[p.idx[j]] = 1;
+            hits++;
+        }
+    }
+    return hits;
+}
+
+void kv_mset(const vector<std::string_view>& keys, const vector<std::string_view>& vals) {
+    if (shards.empty()) return mset(keys, vals);
+    vector<Part>& parts = split(keys, &vals);
+    auto fn = [&](const int s) { mset(parts[s].keys, parts[s].vals); };
+    run_parts(parts, fn);
+    aof_wrote_elsewhere();
+}
+
+void kv_mdel(const vector<std::string_view>& keys) {
+    if (shards.empty()) return mdel(keys);
+    vector<Part>& parts = split(keys, nullptr);
+    auto fn = [&](const int s) { mdel(parts[s].keys); };
+    run_parts(parts, fn);
+    aof_wrote_elsewhere();
+}
+
+static int listen_on(const int port) {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    const int one = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = INADDR_ANY;
+    if (bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) throw std::runtime_error("shard bind failed");
+    listen(fd, SOMAXCONN);
+    return fd;
+}
+
+[[noreturn]] static void shard_main(const int s, const int cpu, const int port, const Handler on_data) {
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    my_shard = s;
+    my_tb = &shards[s]->root;
+    run_epoll_loop(listen_on(port), on_data, shards[s]->wake_fd, on_wake);
+}
+
+vector<atomic<Table*>*> kv_roots() {
+    if (shards.empty()) return {&tb};
+    vector<atomic<Table*>*> roots;
+    for (Shard* sh : shards) roots.push_back(&sh->root);
+    return roots;
+}
+
+int kv_owner(const uint64_t h) {
+    return shards.empty() ? 0 : shard_of(h);
+}
+
+void make_shards(const int n) {
+    for (int s = 0; s < n; s++) {
+        auto* sh = new Shard;
+        sh->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (sh->wake_fd < 0) throw std::runtime_error("eventfd failed");
+        sh->inbox.reset(new Spsc<Fwd*, FWD_RING>[n]);
+        shards.push_back(sh);
+    }
+}
+
+void run_shards(const int port, const Handler on_data) {
+    const int n = static_cast<int>(shards.size());
+
+    // shard s on the s-th cpu we may run on ; unpinned past the last one
+    cpu_set_t allowed;
+    sched_getaffinity(0, sizeof(allowed), &allowed);
+    vector<int> cpus;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &allowed)) cpus.push_back(c);
+    }
+    const auto cpu_of = [&](const int s) { return s < static_cast<int>(cpus.size()) ? cpus[s] : -1; };
+
+    for (int s = 1; s < n; s++) std::thread(shard_main, s, cpu_of(s), port, on_data).detach();
+    shard_main(0, cpu_of(0), port, on_data);
+}
@@ -3,6 +3,7 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
+#include <poll.h>
 #include <string>
 #include <thread>
 #include <vector>
@@ -24,8 +25,20 @@ int make_client() {
     return sock;
 }
 
+bool poll_readable(const int sock, const int timeout_ms) {
+    pollfd p{sock, POLLIN, 0};
+    return poll(&p, 1, timeout_ms) > 0;
+}
+
+// replies aren't checked ; reading them keeps the server's send side moving
+void drain(const int sock) {
+    char buf[16384];
+    while (read(sock, buf, sizeof(buf)) > 0) {}
+}
+
 void worker(const int num_requests, const double rate_per_second) {
     const int sock = make_client();
+    std::thread reader(drain, sock);
 
     std::random_device rd;
     std::mt19937 gen(rd());
@@ -71,11 +84,41 @@ void worker(const int num_requests, const double rate_per_second) {
     }
 
     shutdown(sock, SHUT_WR);
-    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    reader.join();
     close(sock);
 }
 
 
+// one request, its whole reply compared against want
+bool expect(const int sock, const std::string& cmd, const std::string& want) {
+    write(sock, cmd.c_str(), cmd.size());
+    std::string got;
+    char buf[4096];
+    while (got.size() < want.size() && poll_readable(sock, 500)) {
+        const ssize_t bytes = read(sock, buf, sizeof(buf));
+        if (bytes <= 0) break;
+        got.append(buf, bytes);
+    }
+    if (got == want) return true;
+    std::cout << "FAIL " << cmd << "  want " << want << "  got " << got << "\n";
+    return false;
+}
+
+// replies the load test doesn't look at ; exits non-zero on the first mismatch
+int run_checks() {
+    const int sock = make_client();
+    if (sock < 0) return 1;
+    const bool ok = expect(sock, "DEL check_a\n", "+OK\n")
+        && expect(sock, "MSET check_a 1 check_b\n", "-ERR wrong number of arguments\n")
+        && expect(sock, "GET check_a\n", "$-1\n")
+        && expect(sock, "MSET check_a 1 check_b 2\n", "+OK\n")
+        && expect(sock, "MGET check_a check_b\n", "*2\n$1\n1\n$1\n2\n")
+        && expect(sock, "MDEL check_a check_b\n", "+OK\n");
+    close(sock);
+    std::cout << (ok ? "checks passed\n" : "checks failed\n");
+    return ok ? 0 : 1;
+}
+
 void run_test(const int rate, const double duration, const int num_threads) {
     std::cout << rate / 1'000'000 << "M r/s for " << duration << "s :\n\n";
 
@@ -100,17 +143,33 @@ void run_test(const int rate, const double duration, const int num_threads) {
 
     std::this_thread::sleep_for(std::chrono::seconds(1));
 
+    // the report may be several reads long ; it's done once the socket goes quiet
     char buffer[4096];
-    if (const ssize_t bytes = read(admin_sock, buffer, sizeof(buffer)); bytes > 0)
+    while (poll_readable(admin_sock, 500)) {
+        const ssize_t bytes = read(admin_sock, buffer, sizeof(buffer));
+        if (bytes <= 0) break;
         std::cout << std::string(buffer, bytes);
+    }
     std::cout << "\n";
 
     close(admin_sock);
 }
 
-int main() {
+// zoom_test [rate] [seconds] [threads] runs one pass ; no args runs the sweep below
+// zoom_test check runs the reply checks instead
+int main(const int argc, char** argv) {
     std::cout << "\n";
 
+    if (argc > 1 && std::string(argv[1]) == "check") return run_checks();
+
+    if (argc > 1) {
+        const int rate = std::stoi(argv[1]);
+        const double duration = argc > 2 ? std::stod(argv[2]) : 0.2;
+        const int num_threads = argc > 3 ? std::stoi(argv[3]) : 7;
+        run_test(rate, duration, num_threads);
+        return 0;
+    }
+
     constexpr int thread_counts[] = {7};
 
     for (const int num_threads : thread_counts) {
@@ -0,0 +1,38 @@
+#include "types.h"
+#include "reclaim.h"
+#include "ops.h"
+#include <iostream>
+#include <string>
+
+// grows the table with inline keys, deletes them all so it shrinks back, and checks
+// the tables it went through were freed along the way ; built once per reclaimer
+
+#ifdef ZOOM_RECLAIM_EBR
+constexpr const char* SCHEME = "ebr";
+#else
+constexpr const char* SCHEME = "hp";
+#endif
+
+// the last table or two can still be held by the op that retired them
+constexpr size_t MAX_PENDING = 2;
+
+int main(const int argc, char** argv) {
+    const size_t n = argc > 1 ? std::stoul(argv[1]) : 1'000'000;
+
+    get_my_hp_index();
+    for (size_t i = 0; i < n; i++) set("k" + std::to_string(i), "v");
+    const size_t grown = tb.load(acquire)->cap;
+    for (size_t i = 0; i < n; i++) del("k" + std::to_string(i));
+    const size_t shrunk = tb.load(acquire)->cap;
+    const size_t pending = pending_tables();
+    release_hp_index();
+
+    std::cout << "[" << SCHEME << "] " << n << " keys | cap " << grown << " -> " << shrunk
+              << " | " << pending << " retired tables pending\n";
+
+    if (shrunk != INIT_CAPACITY || pending > MAX_PENDING) {
+        std::cerr << "old tables were not reclaimed\n";
+        return 1;
+    }
+    return 0;
+}